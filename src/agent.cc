@@ -1,10 +1,15 @@
 #include <iostream>
+#ifndef NAV_HEADLESS
 #include <raylib.h>
+#endif
 
 #include "agent.hh"
 #include "pathfinder.hh"
 #include "util.hh"
 
+const int settle_frames = 10; // Updates at rest before the agent is checked against its path
+const float min_progress = 0.1; // Least distance along x an agent following its path covers in settle_frames
+
 Agent::Agent(b2WorldId world, float x, float y) {
 	b2BodyDef bodyDef = b2DefaultBodyDef();
 	bodyDef.position = {x, y};
@@ -27,6 +32,10 @@ Agent::Agent(b2WorldId world, float x, float y) {
 	// b2CreateCapsuleShape(body, &shapeDef, &capsule);
 }
 
+AgentProfile Agent::profile() const {
+	return AgentProfile { max_speed, jump_speed, static_cast<int>( ceil(width) ), static_cast<int>( ceil(height) ) };
+}
+
 b2Vec2 Agent::get_position() const {
 	return b2Body_GetPosition(body);
 }
@@ -58,16 +67,31 @@ void Agent::move_towards(b2Vec2 point, float speed) {
 	set_velocity( sign(dx) * abs(speed), get_velocity().y );
 }
 
-void Agent::render() {
+bool Agent::can_see(const Tilemap& tilemap, b2Vec2 p) const {
+	// Look from the center of the agent's top tile
+	b2Vec2 eye = get_position() - b2Vec2 {0.0f, height/2.0f - 0.5f};
+	return tilemap.line_of_sight(eye, p);
+}
+
+#ifndef NAV_HEADLESS
+bool Agent::visible(Rectangle view) const {
 	auto position = get_position();
+	b2Vec2 extent = b2Vec2 {width/2.0f, height/2.0f};
+	return in_view(view, (position - extent) * world_scale, (position + extent) * world_scale);
+}
 
-	DrawRectangle(
-		(position.x-width/2.0)*world_scale,
-		(position.y-height/2.0)*world_scale,
-		width*world_scale,
-		height*world_scale,
-		PURPLE
-	);
+void Agent::render(Rectangle view) {
+	auto position = get_position();
+
+	if ( visible(view) ) {
+		DrawRectangle(
+			(position.x-width/2.0)*world_scale,
+			(position.y-height/2.0)*world_scale,
+			width*world_scale,
+			height*world_scale,
+			PURPLE
+		);
+	}
 
 	// Render Path
 	if ( path.size() == 0 ) return;
@@ -75,15 +99,32 @@ void Agent::render() {
 	for (int i = 0; i < path.size() - 1; i++) {
 		b2Vec2 p0 = path[i].start * world_scale;
 		b2Vec2 p1 = path[i+1].start * world_scale;
+		if ( !in_view(view, p0, p1, 2.0) ) continue;
 
 		DrawCircle(p0.x, p0.y, 2, ORANGE);
 		DrawLine(p0.x, p0.y, p1.x, p1.y, ORANGE);
 	}
 }
+#endif
+
+void Agent::update(float dt) {
+	settled_frames = abs(get_velocity().y) < 0.01? settled_frames + 1 : 0;
+
+	// Progress is measured from where the agent was when it came to rest, jumps and falls start it over
+	if (settled_frames == 0) progress_frames = 0;
+	if (progress_frames == 0) progress_x = get_position().x;
+	progress_frames++;
 
-void Agent::update() {
 	if (path.size() == 0) return;
 
+	// Hold at the start of the segment while the node ahead is reserved
+	if ( path[0].wait > 0.0 && at(path[0].start) ) {
+		path[0].wait -= dt;
+		set_velocity( 0, get_velocity().y );
+		progress_frames = 0; // Waiting isn't being stuck
+		return;
+	}
+
 	// Move towards next point
 	int sub_goal = path.size() > 1? 1 : 0; // If there are multiple points move to next, else move to final
 	float vx = path[0].velocity.y == 0.0? max_speed : path[0].velocity.x; // On jump segments use its speed for accuracy
@@ -100,6 +141,119 @@ void Agent::update() {
 		path.clear();
 		set_velocity(0,0);
 	}
+
+	// Once at rest the agent should be on the current segment and moving along it, a missed jump leaves it elsewhere
+	// The velocity was just commanded so it says nothing, whether the agent actually got anywhere does
+	if ( path.size() > 1 && progress_frames >= settle_frames ) {
+		bool stuck = abs(get_position().x - progress_x) < min_progress;
+		if ( stuck || !on_segment() ) off_path = true;
+
+		progress_frames = 0; // Measure again over the next window, so a repair that doesn't get it moving is caught too
+	}
+}
+
+void Agent::follow(const NavMesh& nav_mesh, float dt) {
+	// Move along the path without simulating, walks at max speed, falls under gravity and jumps along their arcs
+	if (path.size() == 0) return;
+
+	float offset = 0.5 - height/2.0; // From a node, at the center of the tile stood in, to the body's center
+
+	if (path.size() == 1) {
+		set_position( path[0].start + b2Vec2 {0.0f, offset} );
+		path.clear();
+		follow_velocity = {0, 0};
+		return;
+	}
+
+	if (path[0].wait > 0.0) {
+		path[0].wait -= dt;
+		follow_velocity = {0, 0};
+		return;
+	}
+
+	b2Vec2 p0 = path[0].start, p1 = path[1].start;
+	b2Vec2 v = path[0].velocity;
+
+	bool jump = v.y != 0.0;
+	if (!jump) v = b2Vec2 { sign(p1.x - p0.x) * max_speed, 0.0f };
+
+	// Falls step off the ledge then drop until they land, matching the free fall time they were planned with
+	if (!jump && p1.y > p0.y) {
+		float x = get_position().x + v.x * dt;
+		if ( (x - p1.x) * sign(v.x) >= 0.0 ) x = p1.x;
+
+		float y = get_position().y - offset;
+		float vy = y > p0.y + 0.01? follow_velocity.y + nav_mesh.gravity * dt : nav_mesh.gravity * dt; // Still on the ledge starts from rest
+		y += vy * dt;
+
+		if (x == p1.x && y >= p1.y) {
+			set_position( p1 + b2Vec2 {0.0f, offset} );
+			follow_velocity = {0, 0};
+			path.pop_front();
+			return;
+		}
+
+		follow_velocity = b2Vec2 { x == p1.x? 0.0f : v.x, vy };
+		set_position( b2Vec2 {x, std::min(y, p1.y) + offset} );
+		return;
+	}
+
+	// Step along x then find the height on the segment there
+	float x = get_position().x + v.x * dt;
+	bool arrived = v.x == 0.0 || (x - p1.x) * sign(v.x) >= 0.0;
+	if (arrived) x = p1.x;
+
+	float y = jump? nav_mesh.projectile(v, p0, x) : p1.y; // Walks stay level
+
+	float t = v.x == 0.0? 0.0 : (x - p0.x) / v.x;
+	follow_velocity = b2Vec2 { v.x, jump? v.y + nav_mesh.gravity * t : 0.0f };
+
+	if (arrived) {
+		set_position( p1 + b2Vec2 {0.0f, offset} );
+		path.pop_front();
+		return;
+	}
+
+	set_position( b2Vec2 {x, y + offset} );
+}
+
+void Agent::set_simulation(Simulation mode) {
+	if (mode == simulation) return;
+
+	if (simulation == Simulation::KINEMATIC) {
+		// Pick up the physics where following left off
+		b2Body_Enable(body);
+		b2Body_SetLinearVelocity(body, follow_velocity);
+	}
+
+	switch (mode) {
+		case Simulation::DYNAMIC:
+			b2Body_SetAwake(body, true);
+			break;
+		case Simulation::KINEMATIC:
+			follow_velocity = get_velocity(); // Read before disabling, a disabled body has no velocity
+			b2Body_Disable(body);
+			break;
+		case Simulation::ASLEEP:
+			b2Body_SetAwake(body, false);
+			break;
+	}
+
+	simulation = mode;
+}
+
+void Agent::update_simulation(bool visible) {
+	// Only agents on screen with somewhere to go need the full simulation
+	if ( path.empty() ) set_simulation( settled_frames >= settle_frames? Simulation::ASLEEP : Simulation::DYNAMIC );
+	else set_simulation( visible? Simulation::DYNAMIC : Simulation::KINEMATIC );
+}
+
+bool Agent::on_segment() {
+	b2Vec2 p0 = path[0].start, p1 = path[1].start;
+	float x = get_position().x;
+
+	bool level = abs(get_position().y - p0.y) < 0.75 || abs(get_position().y - p1.y) < 0.75;
+	return level && x > std::min(p0.x, p1.x) - 0.5 && x < std::max(p0.x, p1.x) + 0.5;
 }
 
 bool Agent::at(b2Vec2 p) {
@@ -5,13 +5,26 @@
 #include "physics.hh"
 #include "pathfinder.hh"
 
+// Level of detail for an agent's physics
+enum class Simulation {
+	DYNAMIC, // Fully simulated
+	KINEMATIC, // Removed from the world and moved along its path by follow()
+	ASLEEP, // Idle, left asleep until something touches it
+};
+
 class Agent {
 private:
 	b2WorldId world;
 	b2BodyId body;
 
+	int settled_frames = 0; // Updates in a row without moving vertically
+	int progress_frames = 0; // Updates at rest since progress_x was taken
+	float progress_x = 0.0; // Where the agent was when progress along its path was last measured from
+	b2Vec2 follow_velocity = {0, 0}; // Velocity along the path while following, handed back to physics after
+
 	bool at(b2Vec2 p);
 	bool at_x(b2Vec2 p);
+	bool on_segment();
 
 public:
 	const float width = 1.0;
@@ -21,10 +34,15 @@ public:
 	const float jump_speed = 10.0;
 
 	Path path;
+	bool needs_replan = false; // Set when the nav mesh changed under path
+	bool off_path = false; // Set when the agent came to rest somewhere its path doesn't go
+	Simulation simulation = Simulation::DYNAMIC;
 
 	Agent();
 	Agent(b2WorldId world, float x, float y);
 
+	AgentProfile profile() const;
+
 	b2Vec2 get_position() const;
 	void set_position(float x, float y);
 	void set_position(b2Vec2 v);
@@ -34,6 +52,14 @@ public:
 	void set_velocity(b2Vec2 v);
 	void move_towards(b2Vec2 point, float speed);
 
-	void update();
-	void render();
+	bool can_see(const Tilemap& tilemap, b2Vec2 p) const;
+
+	void update(float dt);
+	void follow(const NavMesh& nav_mesh, float dt);
+	void set_simulation(Simulation mode);
+	void update_simulation(bool visible);
+#ifndef NAV_HEADLESS
+	bool visible(Rectangle view) const;
+	void render(Rectangle view);
+#endif
 };
@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "crowd_planner.hh"
+#include "agent.hh"
+
+using namespace std;
+
+CrowdPlanner::CrowdPlanner(NavMesh& nav_mesh, float step_time, int window) : nav_mesh(nav_mesh), reservations(step_time, window) {
+
+}
+
+CrowdPlanner::Member* CrowdPlanner::find(const Agent& agent) {
+	for (auto& member : members)
+		if (member.agent == &agent) return &member;
+
+	return nullptr;
+}
+
+Pathfinder* CrowdPlanner::pathfinder_for(const Agent& agent) {
+	// Each one holds a search context for the whole reservation window, so they're only made per profile
+	AgentProfile profile = agent.profile();
+
+	for (auto& pathfinder : pathfinders)
+		if (pathfinder->get_profile() == profile) return pathfinder.get();
+
+	pathfinders.push_back( make_unique<Pathfinder>(profile, nav_mesh) );
+	return pathfinders.back().get();
+}
+
+void CrowdPlanner::plan(Member& member, bool stagger) {
+	// Replace the member's reservations with ones for a fresh path from where it is now
+	reservations.release(member.id);
+
+	// The next replan is due once half the window is used up
+	// Members planned together are spread over that half so they don't all replan in the same update
+	int half = reservations.get_window() / 2;
+	member.horizon = reservations.current_step() + reservations.get_window();
+	if (stagger && half > 0) member.horizon -= member.id % half;
+
+	if ( !nav_mesh.valid() ) return;
+
+	SearchStats stats;
+	member.agent->path = member.pathfinder->find_path(member.agent->get_position(), member.goal, reservations, member.id, stats);
+}
+
+void CrowdPlanner::add(Agent& agent, b2Vec2 goal) {
+	// New agents get the lowest priority
+	if ( find(agent) ) return set_goal(agent, goal);
+
+	members.push_back( Member {&agent, pathfinder_for(agent), goal, next_id++} );
+	plan(members.back(), true);
+}
+
+void CrowdPlanner::remove(Agent& agent) {
+	auto member = find_if( members.begin(), members.end(), [&](const Member& m) { return m.agent == &agent; } );
+	if ( member == members.end() ) return;
+
+	reservations.release(member->id);
+	members.erase(member);
+}
+
+void CrowdPlanner::set_goal(Agent& agent, b2Vec2 goal) {
+	Member* member = find(agent);
+	if (!member) return add(agent, goal);
+
+	member->goal = goal;
+	plan(*member);
+}
+
+void CrowdPlanner::update(float dt) {
+	reservations.advance(dt);
+
+	// Agents whose reservations are half used up plan the next window, highest priority first
+	// Agents at their goal keep planning too so they keep holding the node they stand on
+	int now = reservations.current_step();
+	for (auto& member : members) {
+		if (member.horizon - now <= reservations.get_window() / 2) plan(member);
+	}
+}
+
+void CrowdPlanner::replan() {
+	// Start over in priority order, for when the nav mesh changed under the paths
+	reservations.clear();
+	for (auto& member : members) plan(member, true);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "nav_mesh.hh"
+#include "pathfinder.hh"
+#include "reservation_table.hh"
+
+class Agent;
+
+// Windowed cooperative A* for a group of agents sharing a reservation table
+// Agents plan in priority order and each replans only once its reservations run short of the window,
+// so the window rolls forward a few agents at a time instead of everyone replanning at once
+// Agents must be removed before they are destroyed
+class CrowdPlanner {
+private:
+	struct Member {
+		Agent* agent;
+		Pathfinder* pathfinder; // Shared with the other members of the same profile
+		b2Vec2 goal;
+		int id;
+		int horizon = 0; // Step the member replans at, when its reservations are half used
+	};
+
+	NavMesh& nav_mesh;
+	std::vector<Member> members; // Highest priority first
+	std::vector< std::unique_ptr<Pathfinder> > pathfinders; // One per agent profile, members plan one at a time so they can share
+	int next_id = 0;
+
+	Member* find(const Agent& agent);
+	Pathfinder* pathfinder_for(const Agent& agent);
+	void plan(Member& member, bool stagger = false);
+
+public:
+	ReservationTable reservations;
+
+	CrowdPlanner(NavMesh& nav_mesh, float step_time = 0.25, int window = 32);
+
+	void add(Agent& agent, b2Vec2 goal);
+	void remove(Agent& agent);
+	void set_goal(Agent& agent, b2Vec2 goal);
+	void update(float dt);
+	void replan();
+};
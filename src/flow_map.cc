@@ -0,0 +1,209 @@
+#include <queue>
+#ifndef NAV_HEADLESS
+#include <raylib.h>
+#endif
+
+#include "flow_map.hh"
+#include "util.hh"
+
+using namespace std;
+
+FlowMap::FlowMap(NavMesh& nav_mesh, AgentProfile profile) : nav_mesh(nav_mesh), profile(profile) {
+
+}
+
+bool FlowMap::current() const {
+	return goal != -1 && next_edge.size() == nav_mesh.nodes.size();
+}
+
+void FlowMap::set_goal(b2Vec2 p) {
+	goal_position = p;
+	has_goal = true;
+
+	if ( !nav_mesh.valid() ) {
+		goal = -1;
+		return;
+	}
+
+	int new_goal = nav_mesh.node_at(p);
+
+	// Build the whole field if there is nothing to reuse
+	if ( !current() ) {
+		goal = new_goal;
+		next_edge.assign(nav_mesh.nodes.size(), -1);
+		time.assign(nav_mesh.nodes.size(), INFINITY);
+		time[goal] = 0.0;
+
+		search({goal});
+		return;
+	}
+
+	if (new_goal == goal) return;
+
+	// Nodes whose route already passes through the new goal keep it, only their time changes
+	vector<bool> keep = subtree(new_goal);
+	float offset = time[new_goal];
+
+	for (int node = 0; node < nav_mesh.nodes.size(); node++) {
+		if ( keep[node] ) {
+			time[node] -= offset;
+			continue;
+		}
+
+		time[node] = INFINITY;
+		next_edge[node] = -1;
+	}
+
+	goal = new_goal;
+	time[goal] = 0.0;
+	next_edge[goal] = -1;
+
+	// Only kept nodes that can be reached from the rest of the mesh need to be searched from
+	vector<int> seeds;
+
+	for (int node = 0; node < nav_mesh.nodes.size(); node++) {
+		if ( !keep[node] ) continue;
+
+		for (const int edge : nav_mesh.nodes[node].edges) {
+			const Edge& e = nav_mesh.edges[edge];
+			int other = node == e.a? e.b : e.a;
+			EdgeDirection direction = other == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+
+			if ( keep[other] || !nav_mesh.traversable(edge, direction, profile) ) continue;
+
+			seeds.push_back(node);
+			break;
+		}
+	}
+
+	search(seeds);
+}
+
+void FlowMap::update() {
+	// Call after the nav mesh is regenerated, node indices are no longer valid
+	goal = -1;
+	if (has_goal) set_goal(goal_position);
+}
+
+void FlowMap::search(const vector<int>& seeds) {
+	// Dijkstra's algorithm outward from the seeds following edges backwards
+	typedef pair<float, int> Entry; // Time and node
+	priority_queue< Entry, vector<Entry>, greater<Entry> > open;
+
+	for (const int seed : seeds) open.push( {time[seed], seed} );
+
+	while ( !open.empty() ) {
+		auto [t, node] = open.top();
+		open.pop();
+
+		if (t > time[node]) continue; // Stale entry
+
+		for (const int edge : nav_mesh.nodes[node].edges) {
+			const Edge& e = nav_mesh.edges[edge];
+			int other = node == e.a? e.b : e.a;
+
+			// The agent travels from other to node
+			EdgeDirection direction = other == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+			if ( !nav_mesh.traversable(edge, direction, profile) ) continue;
+
+			float t_other = t + nav_mesh.travel_time(edge, direction, profile);
+			if (t_other >= time[other]) continue;
+
+			time[other] = t_other;
+			next_edge[other] = edge;
+			open.push( {t_other, other} );
+		}
+	}
+}
+
+vector<bool> FlowMap::subtree(int root) const {
+	// Find the nodes whose route to the goal passes through root
+	enum State : char { UNKNOWN, INSIDE, OUTSIDE };
+	vector<State> state(nav_mesh.nodes.size(), UNKNOWN);
+	state[root] = INSIDE;
+
+	vector<int> chain;
+
+	for (int start = 0; start < nav_mesh.nodes.size(); start++) {
+		// Follow the route until it reaches a node that has been classified
+		int node = start;
+		while (state[node] == UNKNOWN) {
+			chain.push_back(node);
+
+			int edge = next_edge[node];
+			if (edge == -1) break; // The goal or a node that can't reach it
+
+			const Edge& e = nav_mesh.edges[edge];
+			node = node == e.a? e.b : e.a;
+		}
+
+		State result = state[node] == UNKNOWN? OUTSIDE : state[node];
+		for (const int n : chain) state[n] = result;
+		chain.clear();
+	}
+
+	vector<bool> inside( nav_mesh.nodes.size() );
+	for (int node = 0; node < nav_mesh.nodes.size(); node++) inside[node] = state[node] == INSIDE;
+
+	return inside;
+}
+
+bool FlowMap::reachable(b2Vec2 position) const {
+	if ( !current() ) return false;
+
+	int node = nav_mesh.node_at(position);
+	return node != -1 && time[node] < INFINITY;
+}
+
+float FlowMap::time_to_goal(b2Vec2 position) const {
+	if ( !reachable(position) ) return INFINITY;
+
+	return time[ nav_mesh.node_at(position) ];
+}
+
+Path FlowMap::step(b2Vec2 position) const {
+	// Next segment from position, O(1) when the agent is standing on a node
+	Path path;
+	if ( !reachable(position) ) return path;
+
+	int node = nav_mesh.node_at(position);
+	int edge = next_edge[node];
+	b2Vec2 start = nav_mesh.nodes[node].position;
+
+	// Already at the goal
+	if (edge == -1) {
+		path.push_back( {start, {0,0}} );
+		return path;
+	}
+
+	const Edge& e = nav_mesh.edges[edge];
+	int other = node == e.a? e.b : e.a;
+	b2Vec2 velocity = node == e.a? e.vel_ab : e.vel_ba;
+
+	path.push_back( {start, velocity} );
+	path.push_back( {nav_mesh.nodes[other].position, {0,0}} );
+
+	return path;
+}
+
+#ifndef NAV_HEADLESS
+void FlowMap::render(Rectangle view) const {
+	if ( !current() ) return;
+
+	// Draw a line from each node toward the next node on its route
+	for (int node = 0; node < nav_mesh.nodes.size(); node++) {
+		int edge = next_edge[node];
+		if (edge == -1) continue;
+
+		const Edge& e = nav_mesh.edges[edge];
+		int other = node == e.a? e.b : e.a;
+
+		b2Vec2 p0 = nav_mesh.nodes[node].position * world_scale;
+		b2Vec2 p1 = nav_mesh.nodes[other].position * world_scale;
+		b2Vec2 mid = (p0 + p1) * 0.5;
+		if ( !in_view(view, p0, mid) ) continue;
+
+		DrawLine(p0.x, p0.y, mid.x, mid.y, SKYBLUE);
+	}
+}
+#endif
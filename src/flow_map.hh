@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "nav_mesh.hh"
+#include "pathfinder.hh"
+
+// Time to goal field shared by any number of agents heading to the same goal
+class FlowMap {
+private:
+	NavMesh& nav_mesh;
+	AgentProfile profile;
+
+	b2Vec2 goal_position = {0,0};
+	bool has_goal = false;
+	int goal = -1;
+	std::vector<int> next_edge; // Edge to take from each node, -1 at the goal or if it can't be reached
+	std::vector<float> time; // Time from each node to the goal
+
+	bool current() const;
+	void search(const std::vector<int>& seeds);
+	std::vector<bool> subtree(int root) const;
+
+public:
+	FlowMap(NavMesh& nav_mesh, AgentProfile profile = AgentProfile());
+
+	void set_goal(b2Vec2 p);
+	void update();
+
+	bool reachable(b2Vec2 position) const;
+	float time_to_goal(b2Vec2 position) const;
+	Path step(b2Vec2 position) const;
+
+#ifndef NAV_HEADLESS
+	void render(Rectangle view) const;
+#endif
+};
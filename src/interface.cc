@@ -20,6 +20,13 @@ void update_camera() {
 	camera.target = Vector2Add(camera.target, dir);
 }
 
+Rectangle camera_view() {
+	// Area of the world on screen, in pixels
+	Vector2 top_left = GetScreenToWorld2D( Vector2 {0, 0}, camera );
+	Vector2 bottom_right = GetScreenToWorld2D( Vector2 {float(GetScreenWidth()), float(GetScreenHeight())}, camera );
+	return Rectangle {top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y};
+}
+
 bool inside_map(const Tilemap& tilemap) {
 	Vector2 pos = Vector2Divide( GetScreenToWorld2D( GetMousePosition(), camera ), Vector2 {Tilemap::tile_size, Tilemap::tile_size} );
 	return ( pos.x > 0 && pos.x < tilemap.get_width() ) && ( pos.y > 0 && pos.y < tilemap.get_height() );
@@ -35,7 +42,7 @@ void get_input(Tilemap& tilemap, NavMesh& nav_mesh, Agent& agent) {
 	if ( IsMouseButtonPressed(MOUSE_BUTTON_LEFT) ) {
 		Vector2 coord = Vector2Divide( GetScreenToWorld2D( GetMousePosition(), camera ), Vector2 {Tilemap::tile_size, Tilemap::tile_size} );
 		tilemap.toggle_tile(coord.x, coord.y);
-		tilemap.generate_collision();
+		tilemap.generate_collision(coord.x, coord.y);
 		nav_mesh.generate();
 	}
 
@@ -10,6 +10,7 @@
 extern Camera2D camera;
 
 void update_camera();
+Rectangle camera_view();
 Vector2 get_target();
 bool inside_map(const Tilemap& tilemap);
 void get_input(Tilemap& tilemap, NavMesh& nav_mesh, Agent& agent);
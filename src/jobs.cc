@@ -0,0 +1,126 @@
+#include <algorithm>
+
+#include "jobs.hh"
+
+using namespace std;
+
+JobSystem jobs( min<int>(thread::hardware_concurrency(), 64) ); // Box2D supports up to 64 workers
+
+thread_local int worker_index = 0; // Threads outside the pool count as worker 0
+
+JobSystem::JobSystem(int workers) {
+	workers = max(workers, 1);
+
+	for (int i = 0; i < workers; i++) queues.push_back( make_unique<Queue>() );
+	for (int i = 1; i < workers; i++) threads.emplace_back(&JobSystem::worker_loop, this, i);
+}
+
+JobSystem::~JobSystem() {
+	{
+		lock_guard<mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	for (auto& thread : threads) thread.join();
+}
+
+int JobSystem::worker_count() const {
+	return queues.size();
+}
+
+int JobSystem::current_worker() const {
+	return worker_index;
+}
+
+JobSystem::Group* JobSystem::parallel_for(int count, int min_range, Work work) {
+	// Split [0, count) into tasks of at least min_range items, returns null if it ran right away
+	if (count <= 0) return nullptr;
+
+	int tasks = clamp(count / max(min_range, 1), 1, worker_count());
+
+	// Not worth handing out
+	if (tasks == 1) {
+		work(0, count, current_worker());
+		return nullptr;
+	}
+
+	Group* group = new Group;
+	group->work = move(work);
+	group->pending = tasks;
+
+	for (int i = 0; i < tasks; i++) {
+		Queue& queue = *queues[ next_queue++ % worker_count() ];
+
+		lock_guard<mutex> lock(queue.mutex);
+		queue.tasks.push_back( Task {group, count * i / tasks, count * (i+1) / tasks} );
+	}
+
+	queued += tasks;
+
+	// Take the lock so a worker can't miss the wake up between checking and sleeping
+	{ lock_guard<mutex> lock(sleep_mutex); }
+	wake.notify_all();
+
+	return group;
+}
+
+void JobSystem::wait(Group* group) {
+	if (!group) return;
+
+	// Help out instead of blocking
+	while (group->pending > 0) {
+		if ( !run_one( current_worker() ) ) this_thread::yield();
+	}
+
+	delete group;
+}
+
+bool JobSystem::run_one(int worker) {
+	Task task;
+	bool found = false;
+
+	// Newest task from our own queue
+	{
+		Queue& queue = *queues[worker];
+		lock_guard<mutex> lock(queue.mutex);
+
+		if ( !queue.tasks.empty() ) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+			found = true;
+		}
+	}
+
+	// Otherwise steal the oldest task from another worker
+	for (int i = 1; i < worker_count() && !found; i++) {
+		Queue& queue = *queues[ (worker + i) % worker_count() ];
+		lock_guard<mutex> lock(queue.mutex);
+
+		if ( !queue.tasks.empty() ) {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			found = true;
+		}
+	}
+
+	if (!found) return false;
+
+	queued--;
+	task.group->work(task.start, task.end, worker);
+	task.group->pending--;
+
+	return true;
+}
+
+void JobSystem::worker_loop(int worker) {
+	worker_index = worker;
+
+	while (true) {
+		if ( run_one(worker) ) continue;
+
+		unique_lock<mutex> lock(sleep_mutex);
+		wake.wait(lock, [&]{ return stopping || queued > 0; });
+		if (stopping && queued == 0) return;
+	}
+}
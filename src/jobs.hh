@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Fixed pool of worker threads shared by physics and navigation
+// Each worker has its own queue and steals from the others when it runs dry
+// Worker 0 is the thread that owns the pool, it runs tasks while it waits
+class JobSystem {
+public:
+	typedef std::function<void(int start, int end, int worker)> Work;
+
+	struct Group {
+		Work work;
+		std::atomic<int> pending; // Tasks that haven't finished
+	};
+
+private:
+	struct Task {
+		Group* group;
+		int start, end;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> threads;
+	std::vector< std::unique_ptr<Queue> > queues; // One per worker
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<int> queued = 0;
+	std::atomic<int> next_queue = 0;
+	bool stopping = false;
+
+	bool run_one(int worker);
+	void worker_loop(int worker);
+
+public:
+	JobSystem(int workers = std::thread::hardware_concurrency());
+	~JobSystem();
+
+	int worker_count() const;
+	int current_worker() const;
+
+	Group* parallel_for(int count, int min_range, Work work);
+	void wait(Group* group);
+};
+
+extern JobSystem jobs;
@@ -11,9 +11,12 @@
 #include "tilemap.hh"
 #include "nav_mesh.hh"
 #include "pathfinder.hh"
+#include "path_index.hh"
 
 using namespace std;
 
+const float stream_radius = 32.0; // Chunks within this many tiles of the agent stay loaded
+
 int main(int argc, char const *argv[]) {
 	// Create window
 	InitWindow(1280, 720, "Platformer Navigation Test");
@@ -25,38 +28,79 @@ int main(int argc, char const *argv[]) {
 	NavMesh nav_mesh(tilemap);
 	Agent agent(world, 10.0, 10.0);
 	Pathfinder pathfinder(agent, nav_mesh);
+	PathIndex path_index(tilemap);
 
 	b2Vec2 closest = {-1000, -1000};
+	b2Vec2 goal = {0, 0};
+	bool show_heatmap = false;
 
 	while ( !WindowShouldClose() ) {
 		update_world(world);
 		update_camera();
 		get_input(tilemap, nav_mesh, agent);
 
-		agent.update();
+		if ( tilemap.stream({agent.get_position()}, stream_radius) ) nav_mesh.generate();
+
+		// Replan only if an edit touched the agent's path
+		path_index.invalidate( nav_mesh.get_changes() );
+
+		// An agent that fell off its path first tries to rejoin it nearby
+		if (agent.off_path) {
+			agent.off_path = false;
+			if ( agent.path.size() > 0 && pathfinder.repair() ) path_index.track(agent);
+			else agent.needs_replan = true;
+		}
+
+		if (agent.needs_replan) {
+			agent.needs_replan = false;
+			if ( agent.path.size() > 0 && nav_mesh.valid() ) agent.path = pathfinder.set_goal(goal);
+			path_index.track(agent);
+		}
+
+		// Agents off screen follow their path without physics
+		Rectangle view = camera_view();
+		agent.update_simulation( agent.visible(view) );
+
+		if (agent.simulation == Simulation::KINEMATIC) agent.follow( nav_mesh, GetFrameTime() );
+		else agent.update( GetFrameTime() );
+
+		if ( IsKeyPressed(KEY_H) ) show_heatmap = !show_heatmap;
 
 		if ( IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) && nav_mesh.valid() ) {
 			auto target = get_target();
 			auto node = nav_mesh.get_closest( b2Vec2{target.x, target.y} );
 			closest = node.position;
-			agent.path = pathfinder.set_goal( b2Vec2{target.x, target.y} );
+			goal = b2Vec2{target.x, target.y};
+			agent.path = pathfinder.set_goal(goal);
+			path_index.track(agent);
 		}
 
+		// Redraw edited chunks before the camera is applied
+		tilemap.bake();
+		view = camera_view();
+
 		BeginDrawing();
 
 			BeginMode2D(camera);
 
 			ClearBackground(RAYWHITE);
 
-			tilemap.render();
-			nav_mesh.render();
-			agent.render();
-			pathfinder.render();
+			tilemap.render(view);
+			nav_mesh.render(view);
+			agent.render(view);
+			pathfinder.render(view);
+			if (show_heatmap) pathfinder.render_heatmap(view);
 			DrawCircle(closest.x*world_scale, closest.y*world_scale, 4.0, ORANGE);
 
 			EndMode2D();
 
 			DrawFPS(10, 10);
+
+			if (show_heatmap) {
+				const SearchTotals& totals = pathfinder.totals;
+				DrawText( TextFormat("queries %i  expanded %li  relaxed %li  peak open %i  fallbacks %i",
+					totals.queries, totals.expanded, totals.relaxed, totals.peak_open, totals.fallbacks), 10, 40, 20, DARKGRAY );
+			}
 		EndDrawing();
 	}
 
@@ -1,56 +1,301 @@
 #include <iostream>
 #include <algorithm>
+#include <queue>
+#include <unordered_map>
 
 #include "nav_mesh.hh"
 #include "tilemap.hh"
+#include "util.hh"
+#include "jobs.hh"
 
 using namespace std;
 
-NavMesh::NavMesh(Tilemap& tilemap) : tilemap(tilemap) {
-	generate();
+NavMesh::NavMesh(const Tilemap& tilemap, bool build) : tilemap(tilemap) {
+	if (build) generate();
 }
 
 void NavMesh::generate() {
-	nodes.clear();
-	edges.clear();
+	// Keep the old mesh to find what changed
+	vector<Node> old_nodes;
+	vector<Edge> old_edges;
+	vector< vector<int> > old_tile_nodes;
+	nodes.swap(old_nodes);
+	edges.swap(old_edges);
+	tile_nodes.swap(old_tile_nodes);
+
+	if (gravity != template_gravity || max_jump_dist != template_dist) build_jump_templates();
+
+	tile_nodes.assign(tilemap.chunk_count(), {});
+	chunk_nodes.assign(tilemap.chunk_count(), {});
+
+	// Create nodes chunk by chunk, evicted chunks get no nodes or tile lookup
+	for (int chunk = 0; chunk < tilemap.chunk_count(); chunk++) {
+		if ( !tilemap.chunk_loaded(chunk) ) continue;
+		tile_nodes[chunk].assign(Tilemap::chunk_size * Tilemap::chunk_size, -1);
+
+		TileRect bounds = tilemap.chunk_bounds(chunk);
+		for (int x = bounds.x0; x <= bounds.x1; x++)
+		for (int y = bounds.y0; y <= bounds.y1 && y < tilemap.get_height() - 1; y++) {
+			if (tilemap(x, y) == Tile::WALL) continue; // Skip filled tiles
+			if (tilemap(x, y+1) == Tile::EMPTY) continue; // Check if tile below is filled
+			if ( !tilemap.loaded(x, y+1) ) continue; // Unloaded tiles read as walls but can't be stood on
+
+			// If it's filled place a node there
+			const b2Vec2 offset = b2Vec2 {0.5, 0.5};
+			b2Vec2 p = b2Vec2 { static_cast<float>(x), static_cast<float>(y) } + offset;
+
+			Node n;
+			n.position = p;
+			n.clearance = tilemap.clearance(x, y);
+			nodes.push_back(n);
+			tile_nodes[chunk][ (y % Tilemap::chunk_size) * Tilemap::chunk_size + x % Tilemap::chunk_size ] = nodes.size() - 1;
+			chunk_nodes[chunk].push_back(nodes.size() - 1);
+		}
+	}
+
+	// Create edges
+	edges.reserve(nodes.size() * 4);
 
-	nodes.reserve( tilemap.get_width() * tilemap.get_height() );
+	// Falls can cross any number of chunks, so follow each ledge down to where it lands
+	for (int node = 0; node < nodes.size(); node++) {
+		TileCoord t = nodes[node].position;
 
-	// Create nodes
-	for (int x = 0; x < tilemap.get_width(); x++)
-	for (int y = 0; y < tilemap.get_height() - 1; y++) {
-		if (tilemap(x, y) == Tile::WALL) continue; // Skip filled tiles
-		if (tilemap(x, y+1) == Tile::EMPTY) continue; // Check if tile below is filled
+		for (int x : {t.x - 1, t.x + 1})
+		for (int y = t.y + 1; y < tilemap.get_height(); y++) {
+			if (tilemap(x, y) == Tile::WALL) break;
 
-		// If it's filled place a node there
-		const b2Vec2 offset = b2Vec2 {0.5, 0.5};
-		b2Vec2 p = b2Vec2 { static_cast<float>(x), static_cast<float>(y) } + offset;
+			int other = tile_node(x, y);
+			if (other == -1 || !can_fall(node, other) ) continue;
 
-		Node n;
-		n.position = p;
-		nodes.push_back(n);
+			add_edge( fall_edge( min(node, other), max(node, other) ) );
+			break;
+		}
 	}
 
-	// Create edges
-	edges.reserve(nodes.size() * 4);
+	// Each node's walks and jumps are found in parallel then added in order
+	vector< vector<Edge> > found( nodes.size() );
 
-	for (int node = 0; node < nodes.size(); node++)
-	for (int other = 0; other < nodes.size(); other++) {
-		if (node == other) continue; // You can't connect to yourself
-		if ( has_connection(node, other) ) continue; // Check if already connected
+	jobs.wait( jobs.parallel_for(nodes.size(), 16, [&](int start, int end, int) {
+		for (int node = start; node < end; node++) find_edges(node, found[node]);
+	}) );
 
-		if ( can_walk(node, other) ) add_walk_edge(node, other);
-		else if ( can_fall(node, other) ) add_fall_edge(node, other);
-		else if ( can_jump(node, other) ) add_jump_edge(node, other);
-	}
+	for (const auto& list : found)
+	for (const auto& e : list) add_edge(e);
 
 	nodes.shrink_to_fit();
 	edges.shrink_to_fit();
+
+	generate_profile_times();
+	generate_landmarks();
+	generate_components();
+	find_changes(old_nodes, old_edges, old_tile_nodes);
+}
+
+// Binary mesh files are raw values in native byte order, vectors are prefixed by their size
+static const uint32_t mesh_magic = 0x4d56414e; // "NAVM"
+static const uint32_t mesh_version = 4;
+
+template <typename T> static void write(ostream& out, const T& value);
+template <typename T> static void write(ostream& out, const vector<T>& values);
+template <typename T> static bool read(istream& in, T& value);
+template <typename T> static bool read(istream& in, vector<T>& values);
+
+static void write(ostream& out, const Node& node) {
+	write(out, node.position);
+	write(out, node.clearance);
+	write(out, node.edges);
+}
+
+static bool read(istream& in, Node& node) {
+	return read(in, node.position) && read(in, node.clearance) && read(in, node.edges);
+}
+
+template <typename T> static void write(ostream& out, const T& value) {
+	out.write( reinterpret_cast<const char*>(&value), sizeof(T) );
+}
+
+template <typename T> static void write(ostream& out, const vector<T>& values) {
+	write( out, static_cast<uint32_t>(values.size()) );
+	for (const auto& value : values) write(out, value);
+}
+
+template <typename T> static bool read(istream& in, T& value) {
+	return bool( in.read( reinterpret_cast<char*>(&value), sizeof(T) ) );
+}
+
+template <typename T> static bool read(istream& in, vector<T>& values) {
+	uint32_t size;
+	if ( !read(in, size) ) return false;
+
+	values.clear();
+	while (values.size() < size) {
+		values.emplace_back();
+		if ( !read(in, values.back()) ) return false;
+	}
+
+	return true;
+}
+
+static uint64_t tile_hash(const Tilemap& tilemap) {
+	// FNV-1a over the tiles as the mesh sees them, evicted chunks read as walls but aren't the same as walls
+	uint64_t hash = 0xcbf29ce484222325;
+	auto mix = [&](uint64_t value) { hash = (hash ^ value) * 0x100000001b3; };
+
+	for (int chunk = 0; chunk < tilemap.chunk_count(); chunk++) mix( tilemap.chunk_loaded(chunk) );
+
+	for (int y = 0; y < tilemap.get_height(); y++)
+	for (int x = 0; x < tilemap.get_width(); x++) mix( static_cast<uint64_t>(tilemap(x, y)) );
+
+	return hash;
+}
+
+// Check every index is below size, or is -1 where that is allowed
+static bool indices_below(const vector<int>& indices, size_t size, bool none_allowed = false) {
+	return all_of( indices.begin(), indices.end(), [&](int i) { return (i >= 0 && size_t(i) < size) || (none_allowed && i == -1); } );
+}
+
+void NavMesh::save(ostream& out) const {
+	write(out, mesh_magic);
+	write(out, mesh_version);
+	write( out, tilemap.get_width() );
+	write( out, tilemap.get_height() );
+	write( out, tile_hash(tilemap) );
+
+	write(out, gravity);
+	write(out, max_jump_dist);
+	write(out, profile);
+
+	write(out, nodes);
+	write(out, edges);
+	write(out, tile_nodes);
+	write(out, chunk_nodes);
+
+	write(out, components);
+	write(out, component_nodes);
+	write(out, component_bounds);
+	write(out, component_dag);
+	write(out, component_reach);
+
+	write(out, landmarks);
+	write(out, landmark_from);
+	write(out, landmark_to);
+}
+
+bool NavMesh::load(istream& in) {
+	// Only meshes saved from the same tiles can be used
+	uint32_t magic, version;
+	int width, height;
+	uint64_t hash;
+	if ( !read(in, magic) || magic != mesh_magic ) return false;
+	if ( !read(in, version) || version != mesh_version ) return false;
+	if ( !read(in, width) || !read(in, height) ) return false;
+	if ( width != tilemap.get_width() || height != tilemap.get_height() ) return false;
+	if ( !read(in, hash) || hash != tile_hash(tilemap) ) return false;
+
+	// Read into locals so a bad file leaves this mesh untouched
+	float file_gravity, file_jump_dist;
+	AgentProfile file_profile;
+	vector<Node> file_nodes;
+	vector<Edge> file_edges;
+	vector< vector<int> > file_tile_nodes, file_chunk_nodes;
+	vector<int> file_components;
+	vector< vector<int> > file_component_nodes;
+	vector< pair<b2Vec2, b2Vec2> > file_component_bounds;
+	vector< vector<int> > file_component_dag;
+	vector< vector<uint64_t> > file_component_reach;
+	vector<int> file_landmarks;
+	vector<float> file_landmark_from, file_landmark_to;
+
+	bool ok = read(in, file_gravity) && read(in, file_jump_dist) && read(in, file_profile)
+		&& read(in, file_nodes) && read(in, file_edges) && read(in, file_tile_nodes) && read(in, file_chunk_nodes)
+		&& read(in, file_components) && read(in, file_component_nodes) && read(in, file_component_bounds)
+		&& read(in, file_component_dag) && read(in, file_component_reach)
+		&& read(in, file_landmarks) && read(in, file_landmark_from) && read(in, file_landmark_to);
+
+	if (!ok) return false;
+
+	// Reject files whose indices don't fit what they hold so a corrupt one can't be read out of bounds
+	size_t node_count = file_nodes.size(), edge_count = file_edges.size(), component_count = file_component_nodes.size();
+
+	for (const auto& node : file_nodes) {
+		if ( !indices_below(node.edges, edge_count) ) return false;
+	}
+
+	for (const auto& edge : file_edges) {
+		if ( !indices_below({edge.a, edge.b}, node_count) ) return false;
+	}
+
+	if ( file_tile_nodes.size() != tilemap.chunk_count() || file_chunk_nodes.size() != tilemap.chunk_count() ) return false;
+	for (const auto& lookup : file_tile_nodes) {
+		if ( !lookup.empty() && lookup.size() != Tilemap::chunk_size * Tilemap::chunk_size ) return false;
+		if ( !indices_below(lookup, node_count, true) ) return false;
+	}
+
+	for (const auto& list : file_chunk_nodes) {
+		if ( !indices_below(list, node_count) ) return false;
+	}
+
+	if ( file_components.size() != node_count || !indices_below(file_components, component_count) ) return false;
+	if ( file_component_bounds.size() != component_count || file_component_dag.size() != component_count ) return false;
+
+	for (size_t c = 0; c < component_count; c++) {
+		if ( file_component_nodes[c].empty() || !indices_below(file_component_nodes[c], node_count) ) return false;
+		if ( !indices_below(file_component_dag[c], c) ) return false; // Edges only lead to lower components
+	}
+
+	if ( !file_component_reach.empty() ) {
+		if ( file_component_reach.size() != component_count ) return false;
+		for (const auto& bits : file_component_reach) {
+			if ( bits.size() != (component_count + 63) / 64 ) return false;
+		}
+	}
+
+	if ( !indices_below(file_landmarks, node_count) ) return false;
+	size_t landmark_times = file_landmarks.size() * node_count;
+	if ( file_landmark_from.size() != landmark_times || file_landmark_to.size() != landmark_times ) return false;
+
+	// Keep the old mesh to find what changed
+	vector<Node> old_nodes;
+	vector<Edge> old_edges;
+	vector< vector<int> > old_tile_nodes;
+	nodes.swap(old_nodes);
+	edges.swap(old_edges);
+	tile_nodes.swap(old_tile_nodes);
+
+	gravity = file_gravity;
+	max_jump_dist = file_jump_dist;
+	profile = file_profile;
+	landmark_count = file_landmarks.size();
+
+	nodes.swap(file_nodes);
+	edges.swap(file_edges);
+	tile_nodes.swap(file_tile_nodes);
+	chunk_nodes.swap(file_chunk_nodes);
+	components.swap(file_components);
+	component_nodes.swap(file_component_nodes);
+	component_bounds.swap(file_component_bounds);
+	component_dag.swap(file_component_dag);
+	component_reach.swap(file_component_reach);
+	landmarks.swap(file_landmarks);
+	landmark_from.swap(file_landmark_from);
+	landmark_to.swap(file_landmark_to);
+
+	generate_profile_times();
+	find_changes(old_nodes, old_edges, old_tile_nodes);
+	return true;
 }
 
-void NavMesh::render() const {
+#ifndef NAV_HEADLESS
+void NavMesh::render(Rectangle view) const {
 	// Draw a line between each node, lines are color coded based on type
 	for (const auto& edge : edges) {
+		b2Vec2 pa = nodes[edge.a].position;
+		b2Vec2 pb = nodes[edge.b].position;
+
+		// Jump arcs rise above both ends
+		float top = edge.type == EdgeType::JUMP? min( jump_apex(pa, edge.vel_ab).y, min(pa.y, pb.y) ) : min(pa.y, pb.y);
+		if ( !in_view(view, b2Vec2 {min(pa.x, pb.x), top} * world_scale, b2Vec2 {max(pa.x, pb.x), max(pa.y, pb.y)} * world_scale) ) continue;
+
 		// Color based on edge type
 		Color color;
 		switch (edge.type) {
@@ -66,9 +311,6 @@ void NavMesh::render() const {
 		}
 
 		if (edge.type == EdgeType::JUMP) {
-			auto pa = nodes[edge.a].position;
-			auto pb = nodes[edge.b].position;
-
 			float lowest = min(pa.x, pb.x);
 			float highest = max(pa.x, pb.x);
 			float d = 0.1;
@@ -89,18 +331,18 @@ void NavMesh::render() const {
 		}
 
 		else {
-			auto pa = nodes[edge.a].position * world_scale;
-			auto pb = nodes[edge.b].position * world_scale;
-			DrawLine(pa.x, pa.y, pb.x, pb.y, color);
+			DrawLine(pa.x*world_scale, pa.y*world_scale, pb.x*world_scale, pb.y*world_scale, color);
 		}
 	}
 
 	// Draw a black dot at each node
 	for (const auto& node : nodes) {
 		b2Vec2 p = node.position * world_scale;
+		if ( !in_view(view, p, p, 2.0) ) continue;
 		DrawCircle(p.x, p.y, 2.0, BLACK);
 	}
 }
+#endif
 
 int NavMesh::closest(b2Vec2 position) const {
 	float dist = INFINITY;
@@ -126,7 +368,136 @@ bool NavMesh::valid() const {
 	return nodes.size() > 0;
 }
 
-bool NavMesh::has_connection(int a, int b) {
+const NavMeshChanges& NavMesh::get_changes() const {
+	return changes;
+}
+
+bool NavMeshChanges::empty() const {
+	return removed.empty() && modified.empty() && added.empty() && tiles.empty();
+}
+
+EdgeKey NavMesh::edge_key(const vector<Node>& from, const Edge& edge) const {
+	TileCoord ta = from[edge.a].position;
+	TileCoord tb = from[edge.b].position;
+
+	int a = tilemap.tile_index(ta.x, ta.y);
+	int b = tilemap.tile_index(tb.x, tb.y);
+
+	return EdgeKey { min(a, b), max(a, b) };
+}
+
+void NavMesh::find_changes(const vector<Node>& old_nodes, const vector<Edge>& old_edges, const vector< vector<int> >& old_tile_nodes) {
+	unsigned int revision = changes.revision + 1;
+	changes = NavMeshChanges();
+	changes.revision = revision;
+
+	auto include = [&](int tile) {
+		auto [x, y] = tilemap.tile_coord(tile);
+		changes.dirty.include(x, y);
+	};
+
+	auto include_edge = [&](const vector<Node>& from, const Edge& edge) {
+		EdgeKey key = edge_key(from, edge);
+		include(key.a);
+		include(key.b);
+
+		// Jumps can sweep tiles above both ends
+		if (edge.type == EdgeType::JUMP) {
+			TileCoord apex = jump_apex(from[edge.a].position, edge.vel_ab);
+			changes.dirty.include( apex.x, max(apex.y, 0) );
+		}
+
+		return key;
+	};
+
+	// Tiles that gained or lost a node, a chunk without a lookup has none
+	for (int chunk = 0; chunk < tile_nodes.size(); chunk++) {
+		const vector<int>* old = chunk < old_tile_nodes.size()? &old_tile_nodes[chunk] : nullptr;
+		if ( tile_nodes[chunk].empty() && (!old || old->empty()) ) continue;
+
+		TileRect bounds = tilemap.chunk_bounds(chunk);
+		for (int x = bounds.x0; x <= bounds.x1; x++)
+		for (int y = bounds.y0; y <= bounds.y1; y++) {
+			int i = (y % Tilemap::chunk_size) * Tilemap::chunk_size + x % Tilemap::chunk_size;
+			bool had_node = old && !old->empty() && (*old)[i] != -1;
+			bool has_node = !tile_nodes[chunk].empty() && tile_nodes[chunk][i] != -1;
+			if (had_node == has_node) continue;
+
+			int tile = tilemap.tile_index(x, y);
+			changes.tiles.push_back(tile);
+			include(tile);
+		}
+	}
+
+	// Index the old edges by the tiles they connect
+	unordered_map<long long, int> old_keys;
+	old_keys.reserve( old_edges.size() );
+
+	for (int edge = 0; edge < old_edges.size(); edge++) {
+		EdgeKey key = edge_key(old_nodes, old_edges[edge]);
+		old_keys[ (long long) key.a << 32 | key.b ] = edge;
+	}
+
+	vector<bool> kept(old_edges.size(), false);
+
+	for (const auto& edge : edges) {
+		EdgeKey key = edge_key(nodes, edge);
+		auto old = old_keys.find( (long long) key.a << 32 | key.b );
+
+		if ( old == old_keys.end() ) {
+			changes.added.push_back( include_edge(nodes, edge) );
+			continue;
+		}
+
+		kept[old->second] = true;
+
+		const Edge& e = old_edges[old->second];
+		bool same_clearance = e.clearance.up == edge.clearance.up && e.clearance.across == edge.clearance.across;
+		if ( e.type == edge.type && e.vel_ab == edge.vel_ab && e.vel_ba == edge.vel_ba && same_clearance ) continue;
+
+		changes.modified.push_back( include_edge(nodes, edge) );
+		include_edge(old_nodes, e);
+	}
+
+	for (int edge = 0; edge < old_edges.size(); edge++) {
+		if ( !kept[edge] ) changes.removed.push_back( include_edge(old_nodes, old_edges[edge]) );
+	}
+}
+
+int NavMesh::node_tile(int node) const {
+	TileCoord tile = nodes[node].position;
+	return tilemap.tile_index(tile.x, tile.y);
+}
+
+int NavMesh::tile_node(int x, int y) const {
+	// Node standing in the tile, -1 if there is none or its chunk isn't loaded
+	int chunk = tilemap.chunk_of(x, y);
+	if ( chunk == -1 || chunk >= tile_nodes.size() || tile_nodes[chunk].empty() ) return -1;
+
+	return tile_nodes[chunk][ (y % Tilemap::chunk_size) * Tilemap::chunk_size + x % Tilemap::chunk_size ];
+}
+
+int NavMesh::tile_node(int tile) const {
+	auto [x, y] = tilemap.tile_coord(tile);
+	return tile_node(x, y);
+}
+
+int NavMesh::node_at(b2Vec2 position) const {
+	// Check the tile at position then the one below it, a standing agent's center can be above its node
+	TileCoord tile = position;
+
+	for (int dy = 0; dy < 2 && position.x >= 0 && position.y >= 0; dy++) {
+		if ( tile.x >= tilemap.get_width() || tile.y + dy >= tilemap.get_height() ) break;
+
+		int node = tile_node(tile.x, tile.y + dy);
+		if (node != -1) return node;
+	}
+
+	// Fall back to a full search
+	return closest(position);
+}
+
+bool NavMesh::has_connection(int a, int b) const {
 	for (auto edge : nodes[a].edges) {
 		if (edges[edge].a == a && edges[edge].b == b) return true;
 		if (edges[edge].b == a && edges[edge].a == b) return true;
@@ -140,7 +511,7 @@ bool NavMesh::has_connection(int a, int b) {
 	return false;
 }
 
-bool NavMesh::can_walk(int a, int b) {
+bool NavMesh::can_walk(int a, int b) const {
 	auto pa = nodes[a].position;
 	auto pb = nodes[b].position;
 
@@ -150,7 +521,7 @@ bool NavMesh::can_walk(int a, int b) {
 	return true;
 }
 
-bool NavMesh::can_jump(int a, int b) {
+bool NavMesh::can_jump(int a, int b) const {
 	// Get their integer coordinates
 	b2Vec2 pa = nodes[a].position;
 	b2Vec2 pb = nodes[b].position;
@@ -169,7 +540,7 @@ bool NavMesh::can_jump(int a, int b) {
 }
 
 
-bool NavMesh::can_fall(int a, int b) {
+bool NavMesh::can_fall(int a, int b) const {
 	// Get their integer coordinates
 	TileCoord ta = nodes[a].position;
 	TileCoord tb = nodes[b].position;
@@ -200,7 +571,7 @@ bool NavMesh::can_fall(int a, int b) {
 	return true;
 }
 
-b2Vec2 NavMesh::best_jump(b2Vec2 a, b2Vec2 b) {
+b2Vec2 NavMesh::best_jump(b2Vec2 a, b2Vec2 b) const {
 	b2Vec2 velocity = {INFINITY,INFINITY};
 	for (float s = 0.1; s < 2.0; s+=0.1) {
 		auto v = jump_velocity(a, b, s); // Find velocity for s
@@ -219,7 +590,7 @@ b2Vec2 NavMesh::best_jump(b2Vec2 a, b2Vec2 b) {
 	return velocity;
 }
 
-b2Vec2 NavMesh::jump_velocity(b2Vec2 a, b2Vec2 b, float s) {
+b2Vec2 NavMesh::jump_velocity(b2Vec2 a, b2Vec2 b, float s) const {
 	b2Vec2 velocity = b2Vec2 {0,0};
 	velocity.x = 1.0 / s;
 	velocity.x = b.x - a.x < 0? -velocity.x : velocity.x;
@@ -231,7 +602,7 @@ b2Vec2 NavMesh::jump_velocity(b2Vec2 a, b2Vec2 b, float s) {
 	return velocity;
 }
 
-b2Vec2 NavMesh::jump_apex(b2Vec2 a, b2Vec2 velocity) {
+b2Vec2 NavMesh::jump_apex(b2Vec2 a, b2Vec2 velocity) const {
 	b2Vec2 apex = b2Vec2 {0,0};
 
 	apex.x = -(velocity.y/gravity) * velocity.x + a.x;
@@ -240,18 +611,77 @@ b2Vec2 NavMesh::jump_apex(b2Vec2 a, b2Vec2 velocity) {
 	return apex;
 }
 
-bool NavMesh::jump_collides(b2Vec2 a, b2Vec2 b, b2Vec2 velocity) {
+vector<TileCoord> NavMesh::jump_sweep(b2Vec2 a, b2Vec2 b, b2Vec2 velocity) const {
+	// Sample the arc and list the tiles it passes through relative to a's tile
+	vector<TileCoord> sweep;
+
 	float lowest = min(a.x, b.x);
 	float highest = max(a.x, b.x);
+	int samples = round( (highest - lowest) / 0.1 );
+
+	for (int i = 0; i <= samples; i++) {
+		float x = lowest + i * 0.1;
+		float y = projectile(velocity, a, x); // Get the hight of the jump arc at x
+		if ( !isfinite(y) ) continue;
+
+		TileCoord tile;
+		tile.x = floor(x) - floor(a.x);
+		tile.y = floor(y) - floor(a.y);
+
+		auto same = [&](const TileCoord& t) { return t.x == tile.x && t.y == tile.y; };
+		if ( none_of(sweep.begin(), sweep.end(), same) ) sweep.push_back(tile);
+	}
+
+	return sweep;
+}
+
+void NavMesh::build_jump_templates() {
+	template_gravity = gravity;
+	template_dist = max_jump_dist;
+	template_range = ceil(max_jump_dist);
+
+	int size = 2 * template_range + 1;
+	jump_templates.assign(size * size, JumpTemplate { {INFINITY, INFINITY}, {} });
+
+	// Solve every offset from the center of a tile
+	const b2Vec2 a = {0.5, 0.5};
+
+	for (int dx = -template_range; dx <= template_range; dx++)
+	for (int dy = -template_range; dy <= template_range; dy++) {
+		if (dx == 0) continue; // Jumps are never straight up
+
+		b2Vec2 b = a + b2Vec2 { static_cast<float>(dx), static_cast<float>(dy) };
+
+		auto& jump = jump_templates[ (dx + template_range) * size + dy + template_range ];
+		jump.velocity = best_jump(a, b);
+		jump.sweep = jump_sweep(a, b, jump.velocity);
+	}
+}
+
+const JumpTemplate* NavMesh::jump_template(int a, int b) const {
+	// Template for jumping from node a to node b, null if they are out of range
+	TileCoord ta = nodes[a].position;
+	TileCoord tb = nodes[b].position;
+	int dx = tb.x - ta.x;
+	int dy = tb.y - ta.y;
 
-	for (float x = lowest; x <= highest; x+=0.1) {
-		b2Vec2 p;
-		p.x = x;
-		p.y = projectile(velocity, a, x); // Get the hight of the jump arc at x
-		TileCoord tile = p; // Convert coordinates to TileCoord
+	if ( abs(dx) > template_range || abs(dy) > template_range ) return nullptr;
 
+	int size = 2 * template_range + 1;
+	return &jump_templates[ (dx + template_range) * size + dy + template_range ];
+}
+
+b2Vec2 NavMesh::jump_between(int a, int b) const {
+	const JumpTemplate* jump = jump_template(a, b);
+	return jump? jump->velocity : best_jump(nodes[a].position, nodes[b].position);
+}
+
+bool NavMesh::sweep_collides(int a, const JumpTemplate& jump) const {
+	TileCoord start = nodes[a].position;
+
+	for (const auto& tile : jump.sweep) {
 		// Check if there is a wall here the jump collides
-		if (tilemap(tile.x, tile.y) == Tile::WALL) return true;
+		if (tilemap(start.x + tile.x, start.y + tile.y) == Tile::WALL) return true;
 	}
 
 	return false;
@@ -263,44 +693,50 @@ float NavMesh::projectile(b2Vec2 v, b2Vec2 p0, float x) const {
 	return y;
 }
 
-void NavMesh::add_walk_edge(int a, int b) {
+Edge NavMesh::walk_edge(int a, int b) const {
 	Edge e;
 	e.a = a;
 	e.b = b;
 	e.type = EdgeType::WALK;
-	e.vel_ab = {1,0}; // TODO: Proper velocity
-	e.vel_ba = {-1,0};
+	float dir = sign(nodes[b].position.x - nodes[a].position.x);
+	e.vel_ab = {dir,0}; // TODO: Proper velocity
+	e.vel_ba = {-dir,0};
 
-	edges.push_back(e);
-	nodes[a].edges.push_back(edges.size() - 1);
-	nodes[b].edges.push_back(edges.size() - 1);
-}
+	e.clearance = nodes[a].clearance;
+	TileCoord tb = nodes[b].position;
+	narrow(e.clearance, tb.x, tb.y);
 
-void NavMesh::add_jump_edge(int a, int b) {
-	b2Vec2 pa = nodes[a].position;
-	b2Vec2 pb = nodes[b].position;
+	return e;
+}
 
-	// Calculate velocity
-	b2Vec2 vel_ab = best_jump(pa, pb);
-	b2Vec2 vel_ba = best_jump(pb, pa);
+bool NavMesh::jump_edge(int a, int b, Edge& e) const {
+	// Look up the jump both ways, can_jump() keeps them in range of the table
+	const JumpTemplate* jump_ab = jump_template(a, b);
+	const JumpTemplate* jump_ba = jump_template(b, a);
+	if (!jump_ab || !jump_ba) return false;
 
-	if ( jump_collides(pa, pb, vel_ab) ) return;
-	if ( jump_collides(pb, pa, vel_ba) ) return;
+	if ( sweep_collides(a, *jump_ab) ) return false;
+	if ( sweep_collides(b, *jump_ba) ) return false;
 
-	// If the jump is good then add an edge
-	Edge e;
+	// If the jump is good then make an edge
 	e.a = a;
 	e.b = b;
 	e.type = EdgeType::JUMP;
-	e.vel_ab = vel_ab;
-	e.vel_ba = vel_ba;
+	e.vel_ab = jump_ab->velocity;
+	e.vel_ba = jump_ba->velocity;
 
-	edges.push_back(e);
-	nodes[a].edges.push_back(edges.size() - 1);
-	nodes[b].edges.push_back(edges.size() - 1);
+	// Narrowest space the arc passes through either way
+	e.clearance = nodes[a].clearance;
+
+	for (auto [node, jump] : { pair{a, jump_ab}, pair{b, jump_ba} }) {
+		TileCoord start = nodes[node].position;
+		for (const auto& tile : jump->sweep) narrow(e.clearance, start.x + tile.x, start.y + tile.y);
+	}
+
+	return true;
 }
 
-void NavMesh::add_fall_edge(int a, int b) {
+Edge NavMesh::fall_edge(int a, int b) const {
 	b2Vec2 pa = nodes[a].position;
 	b2Vec2 pb = nodes[b].position;
 
@@ -308,10 +744,366 @@ void NavMesh::add_fall_edge(int a, int b) {
 	e.a = a;
 	e.b = b;
 	e.type = EdgeType::FALL;
-	e.vel_ab = pa.y < pb.y? b2Vec2 {1,0} : best_jump(pa, pb);
-	e.vel_ba = pb.y < pa.y? b2Vec2 {-1,0} : best_jump(pb, pa);
+	e.vel_ab = pa.y < pb.y? b2Vec2 {sign(pb.x - pa.x),0} : jump_between(a, b);
+	e.vel_ba = pb.y < pa.y? b2Vec2 {sign(pa.x - pb.x),0} : jump_between(b, a);
+
+	// Narrowest space from the ledge down the lower node's column
+	TileCoord high = pa.y < pb.y? pa : pb;
+	TileCoord low = pa.y < pb.y? pb : pa;
+
+	e.clearance = nodes[a].clearance;
+	narrow(e.clearance, high.x, high.y);
+	for (int y = high.y; y <= low.y; y++) narrow(e.clearance, low.x, y);
+
+	return e;
+}
+
+void NavMesh::narrow(Clearance& c, int x, int y) const {
+	Clearance tile = tilemap.clearance(x, y);
+	c.up = min(c.up, tile.up);
+	c.across = min(c.across, tile.across);
+}
 
+void NavMesh::add_edge(const Edge& e) {
 	edges.push_back(e);
-	nodes[a].edges.push_back(edges.size() - 1);
-	nodes[b].edges.push_back(edges.size() - 1);
+	nodes[e.a].edges.push_back(edges.size() - 1);
+	nodes[e.b].edges.push_back(edges.size() - 1);
+}
+
+void NavMesh::find_edges(int node, vector<Edge>& found) const {
+	// Walks and jumps only look at chunks in jump range, which stitches subgraphs across borders
+	int reach = ceil(max_jump_dist / Tilemap::chunk_size);
+
+	TileCoord t = nodes[node].position;
+	int cx = t.x / Tilemap::chunk_size;
+	int cy = t.y / Tilemap::chunk_size;
+
+	for (int y = cy - reach; y <= cy + reach; y++)
+	for (int x = cx - reach; x <= cx + reach; x++) {
+		int chunk = tilemap.chunk_of(x * Tilemap::chunk_size, y * Tilemap::chunk_size);
+		if (chunk == -1) continue;
+
+		for (const int other : chunk_nodes[chunk]) {
+			if (other <= node) continue; // Each pair is checked once, from its first node
+			if ( has_connection(node, other) ) continue; // Check if already connected
+
+			Edge e;
+			if ( can_walk(node, other) ) found.push_back( walk_edge(node, other) );
+			else if ( can_jump(node, other) && jump_edge(node, other, e) ) found.push_back(e);
+		}
+	}
+}
+
+bool NavMesh::traversable(int edge, EdgeDirection direction, const AgentProfile& agent) const {
+	const Edge& e = edges[edge];
+	b2Vec2 velocity = direction == EdgeDirection::A_TO_B? e.vel_ab : e.vel_ba;
+
+	if ( abs(velocity.x) > agent.max_speed || abs(velocity.y) > agent.jump_speed ) return false;
+
+	// Check the agent fits
+	return e.clearance.up >= agent.height && e.clearance.across >= agent.width;
+}
+
+float NavMesh::travel_time(int edge, EdgeDirection direction, const AgentProfile& agent) const {
+	const Edge& e = edges[edge];
+	const b2Vec2 pa = nodes[e.a].position;
+	const b2Vec2 pb = nodes[e.b].position;
+
+	float dx = abs(pa.x - pb.x);
+	float dy = abs(pa.y - pb.y);
+
+	float time, vx;
+
+	switch (e.type) {
+		case EdgeType::WALK:
+			time = dx / agent.max_speed;
+			break;
+		case EdgeType::JUMP:
+			vx = direction == EdgeDirection::A_TO_B? e.vel_ab.x : e.vel_ba.x;
+			time = dx / abs(vx) * 5.0;
+			break;
+		case EdgeType::FALL:
+			time = sqrt( 2 *  dy/abs(gravity) );
+			break;
+	}
+
+	return time;
+}
+
+float NavMesh::heuristic(int node, int goal) const {
+	// ALT lower bound on the time from node to goal using the triangle inequality
+	float h = 0.0;
+
+	for (int l = 0; l < landmarks.size(); l++) {
+		const float* from = &landmark_from[l * nodes.size()];
+		const float* to = &landmark_to[l * nodes.size()];
+
+		// d(L, goal) <= d(L, node) + d(node, goal)
+		if (from[node] < INFINITY) h = max(h, from[goal] - from[node]);
+
+		// d(node, L) <= d(node, goal) + d(goal, L)
+		if (to[goal] < INFINITY) h = max(h, to[node] - to[goal]);
+	}
+
+	return h;
+}
+
+void NavMesh::generate_profile_times() {
+	profile_times.resize( 2 * edges.size() );
+
+	for (int edge = 0; edge < edges.size(); edge++)
+	for (auto direction : {EdgeDirection::A_TO_B, EdgeDirection::B_TO_A}) {
+		bool open = traversable(edge, direction, profile);
+		profile_times[2 * edge + static_cast<int>(direction)] = open? travel_time(edge, direction, profile) : INFINITY;
+	}
+}
+
+void NavMesh::generate_landmarks() {
+	landmarks.clear();
+	landmark_from.clear();
+	landmark_to.clear();
+
+	if ( nodes.empty() ) return;
+
+	landmark_from.reserve(landmark_count * nodes.size());
+	landmark_to.reserve(landmark_count * nodes.size());
+
+	// Pick landmarks by farthest point selection, starting from whatever is farthest from node 0
+	vector<float> score = travel_times(0, false);
+	for (auto& s : score) s = s < INFINITY? -s : -INFINITY; // Farthest reachable node gets the lowest score
+
+	while (landmarks.size() < landmark_count) {
+		int landmark = min_element( score.begin(), score.end() ) - score.begin();
+
+		// Search out from the landmark and back to it at the same time
+		vector<float> from, to;
+		jobs.wait( jobs.parallel_for(2, 1, [&](int start, int end, int) {
+			for (int i = start; i < end; i++) {
+				if (i == 0) from = travel_times(landmark, false);
+				else to = travel_times(landmark, true);
+			}
+		}) );
+
+		landmarks.push_back(landmark);
+		landmark_from.insert(landmark_from.end(), from.begin(), from.end());
+		landmark_to.insert(landmark_to.end(), to.begin(), to.end());
+
+		// Score each node by its distance to the nearest landmark, the next landmark is the farthest
+		if (landmarks.size() == 1) fill(score.begin(), score.end(), -INFINITY);
+		for (int n = 0; n < nodes.size(); n++) {
+			float d = min(from[n], to[n]);
+			score[n] = max(score[n], -d);
+		}
+
+		if ( *min_element( score.begin(), score.end() ) >= 0.0 ) break; // Every node is a landmark
+	}
+}
+
+void NavMesh::generate_components() {
+	// Tarjan's algorithm, components come out sinks first so every edge between
+	// components points from a higher index to a lower one
+	int n = nodes.size();
+	components.assign(n, -1);
+
+	vector<int> index(n, -1), low(n, 0);
+	vector<bool> on_stack(n, false);
+	vector<int> stack;
+	vector< pair<int, int> > calls; // Node and position in its edge list
+	int counter = 0, count = 0;
+
+	auto visit = [&](int node) {
+		index[node] = low[node] = counter++;
+		stack.push_back(node);
+		on_stack[node] = true;
+		calls.push_back( {node, 0} );
+	};
+
+	for (int root = 0; root < n; root++) {
+		if (index[root] != -1) continue;
+		visit(root);
+
+		while ( !calls.empty() ) {
+			auto [node, i] = calls.back();
+
+			// Visit the next edge out of node
+			if ( i < nodes[node].edges.size() ) {
+				calls.back().second++;
+
+				int edge = nodes[node].edges[i];
+				const Edge& e = edges[edge];
+				int other = node == e.a? e.b : e.a;
+				EdgeDirection direction = node == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+				if ( !traversable(edge, direction, profile) ) continue;
+
+				if (index[other] == -1) visit(other);
+				else if ( on_stack[other] ) low[node] = min(low[node], index[other]);
+				continue;
+			}
+
+			// Node is finished, if it's a root pop its component
+			if (low[node] == index[node]) {
+				int member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					on_stack[member] = false;
+					components[member] = count;
+				} while (member != node);
+
+				count++;
+			}
+
+			calls.pop_back();
+			if ( !calls.empty() ) low[calls.back().first] = min(low[calls.back().first], low[node]);
+		}
+	}
+
+	component_nodes.assign(count, {});
+	component_bounds.assign(count, { {INFINITY, INFINITY}, {-INFINITY, -INFINITY} });
+
+	for (int node = 0; node < n; node++) {
+		int c = components[node];
+		b2Vec2 p = nodes[node].position;
+
+		component_nodes[c].push_back(node);
+		component_bounds[c].first = { min(component_bounds[c].first.x, p.x), min(component_bounds[c].first.y, p.y) };
+		component_bounds[c].second = { max(component_bounds[c].second.x, p.x), max(component_bounds[c].second.y, p.y) };
+	}
+
+	// Condense the graph into a DAG of components
+	component_dag.assign(count, {});
+	for (int edge = 0; edge < edges.size(); edge++) {
+		const Edge& e = edges[edge];
+		int ca = components[e.a], cb = components[e.b];
+		if (ca == cb) continue;
+
+		if ( traversable(edge, EdgeDirection::A_TO_B, profile) ) component_dag[ca].push_back(cb);
+		if ( traversable(edge, EdgeDirection::B_TO_A, profile) ) component_dag[cb].push_back(ca);
+	}
+
+	// Each component reaches itself and whatever its successors reach, successors always come first
+	// This takes count^2 bits, so past max_reach_components reach is searched for in the DAG per query instead
+	component_reach.clear();
+	if (count > max_reach_components) return;
+
+	int words = (count + 63) / 64;
+	component_reach.assign( count, vector<uint64_t>(words, 0) );
+
+	for (int c = 0; c < count; c++) {
+		component_reach[c][c / 64] |= uint64_t(1) << (c % 64);
+
+		for (const int next : component_dag[c])
+		for (int w = 0; w < words; w++) component_reach[c][w] |= component_reach[next][w];
+	}
+}
+
+const vector<int>& NavMesh::search_reach(int component, int target) const {
+	// Components reachable from component in the DAG, stopping early at target if it's given
+	// Edges only lead to lower indices so components below target can't lead to it
+	// Scratch space is per thread since pathfinders query the mesh from several workers at once
+	static thread_local vector<unsigned int> seen;
+	static thread_local unsigned int stamp = 0;
+	static thread_local vector<int> stack, found;
+
+	if ( seen.size() < component_dag.size() ) seen.resize(component_dag.size(), 0);
+	if (++stamp == 0) {
+		fill(seen.begin(), seen.end(), 0);
+		stamp = 1;
+	}
+
+	int lowest = max(target, 0);
+	found.clear();
+	stack.assign(1, component);
+	seen[component] = stamp;
+
+	while ( !stack.empty() ) {
+		int c = stack.back();
+		stack.pop_back();
+		found.push_back(c);
+		if (c == target) break;
+
+		for (const int next : component_dag[c]) {
+			if (next < lowest || seen[next] == stamp) continue;
+			seen[next] = stamp;
+			stack.push_back(next);
+		}
+	}
+
+	return found;
+}
+
+bool NavMesh::reachable(int from, int to) const {
+	int a = components[from], b = components[to];
+	if (a == b) return true;
+	if ( !component_reach.empty() ) return component_reach[a][b / 64] >> (b % 64) & 1;
+
+	const vector<int>& found = search_reach(a, b);
+	return found.back() == b;
+}
+
+int NavMesh::nearest_reachable(int from, b2Vec2 position) const {
+	// Closest node to position that can be reached from node from
+	float dist = INFINITY;
+	int n = -1;
+
+	auto consider = [&](int c) {
+		// Skip components whose bounds are already too far away
+		auto [lower, upper] = component_bounds[c];
+		b2Vec2 nearest = { clamp(position.x, lower.x, upper.x), clamp(position.y, lower.y, upper.y) };
+		if (b2Distance(nearest, position) > dist) return;
+
+		for (const int node : component_nodes[c]) {
+			float d = b2Distance(position, nodes[node].position);
+			if (d > dist) continue;
+
+			dist = d;
+			n = node;
+		}
+	};
+
+	if ( component_reach.empty() ) {
+		for (const int c : search_reach(components[from], -1)) consider(c);
+		return n;
+	}
+
+	for (int c = 0; c < component_nodes.size(); c++) {
+		if ( reachable(from, component_nodes[c][0]) ) consider(c);
+	}
+
+	return n;
+}
+
+vector<float> NavMesh::travel_times(int source, bool reverse) const {
+	// Dijkstra's algorithm over the mesh, reverse searches follow edges backwards
+	vector<float> times(nodes.size(), INFINITY);
+
+	typedef pair<float, int> Entry; // Time and node
+	priority_queue< Entry, vector<Entry>, greater<Entry> > open;
+
+	times[source] = 0.0;
+	open.push( {0.0, source} );
+
+	while ( !open.empty() ) {
+		auto [time, node] = open.top();
+		open.pop();
+
+		if (time > times[node]) continue; // Stale entry
+
+		for (const int edge : nodes[node].edges) {
+			const Edge& e = edges[edge];
+			int other = node == e.a? e.b : e.a;
+
+			int from = reverse? other : node;
+			EdgeDirection direction = from == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+			if ( !traversable(edge, direction, profile) ) continue;
+
+			float t = time + travel_time(edge, direction, profile);
+			if (t >= times[other]) continue;
+
+			times[other] = t;
+			open.push( {t, other} );
+		}
+	}
+
+	return times;
 }
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <iostream>
 
 #include "physics.hh"
+#include "tilemap.hh"
 
-class Tilemap;
 class Pathfinder;
 
 enum class EdgeType {
@@ -18,8 +20,18 @@ enum class EdgeDirection {
 	B_TO_A,
 };
 
+struct AgentProfile {
+	float max_speed = 5.0;
+	float jump_speed = 10.0;
+	int width = 1; // Size in tiles
+	int height = 2;
+
+	bool operator==(const AgentProfile&) const = default;
+};
+
 struct Node {
 	b2Vec2 position;
+	Clearance clearance; // Space at the node's tile
 	std::vector<int> edges; // Edges that connect to this node
 };
 
@@ -28,41 +40,128 @@ struct Edge {
 	EdgeType type;
 	b2Vec2 vel_ab;
 	b2Vec2 vel_ba;
+	Clearance clearance; // Narrowest space along the edge
+};
+
+struct JumpTemplate {
+	b2Vec2 velocity; // Launch velocity from best_jump()
+	std::vector<TileCoord> sweep; // Tiles the arc passes through relative to the start tile
+};
+
+struct EdgeKey {
+	int a, b; // Tiles of the nodes an edge connects, a is the lower index
+};
+
+// Difference between the mesh before and after a call to generate()
+struct NavMeshChanges {
+	unsigned int revision = 0; // Increases with every generate()
+	std::vector<EdgeKey> removed;
+	std::vector<EdgeKey> modified; // Type or velocities changed
+	std::vector<EdgeKey> added;
+	std::vector<int> tiles; // Tiles that gained or lost a node
+	TileRect dirty; // Bounds of every change
+
+	bool empty() const;
 };
 
 class NavMesh {
 private:
-	Tilemap& tilemap;
+	const Tilemap& tilemap;
 	std::vector<Node> nodes;
 	std::vector<Edge> edges;
-
-	bool can_walk(int a, int b);
-	bool can_jump(int a, int b);
-	bool can_fall(int a, int b);
-	bool has_connection(int a, int b);
+	std::vector< std::vector<int> > tile_nodes; // Node standing in each tile of each chunk, -1 if none, empty while the chunk is evicted
+	std::vector< std::vector<int> > chunk_nodes; // Nodes in each tilemap chunk
+	NavMeshChanges changes;
+
+	// Strongly connected components for the preprocessing profile
+	std::vector<int> components; // Component of each node
+	std::vector< std::vector<int> > component_nodes;
+	std::vector< std::pair<b2Vec2, b2Vec2> > component_bounds; // Lower and upper corners of each component
+	std::vector< std::vector<int> > component_dag; // Components each one has an edge to, always lower indices
+	std::vector< std::vector<uint64_t> > component_reach; // Bitset of components each can reach, empty past max_reach_components
+
+	// Jumps only depend on the tile offset, so they are solved once per offset
+	std::vector<JumpTemplate> jump_templates;
+	int template_range = 0; // Largest offset on either axis
+	float template_gravity = NAN, template_dist = NAN; // Settings the table was built with
+
+	// Travel time over each edge for the preprocessing profile, A to B then B to A, infinite if it can't be traversed
+	std::vector<float> profile_times;
+
+	// Landmarks for the A* heuristic, times are stored landmark major
+	std::vector<int> landmarks;
+	std::vector<float> landmark_from; // Time from each landmark to each node
+	std::vector<float> landmark_to; // Time from each node to each landmark
+
+	bool can_walk(int a, int b) const;
+	bool can_jump(int a, int b) const;
+	bool can_fall(int a, int b) const;
+	bool has_connection(int a, int b) const;
 	int closest(b2Vec2 position) const;
-
-	b2Vec2 best_jump(b2Vec2 a, b2Vec2 b);
-	b2Vec2 jump_velocity(b2Vec2 a, b2Vec2 b, float s);
-	b2Vec2 jump_apex(b2Vec2 a, b2Vec2 velocity);
-	bool jump_collides(b2Vec2 a, b2Vec2 b, b2Vec2 velocity);
-
-	float projectile(b2Vec2 v, b2Vec2 p0, float x) const;
-
-	void add_walk_edge(int a, int b);
-	void add_jump_edge(int a, int b);
-	void add_fall_edge(int a, int b);
+	int node_tile(int node) const;
+	int tile_node(int x, int y) const;
+	int tile_node(int tile) const;
+
+	b2Vec2 best_jump(b2Vec2 a, b2Vec2 b) const;
+	b2Vec2 jump_velocity(b2Vec2 a, b2Vec2 b, float s) const;
+	b2Vec2 jump_apex(b2Vec2 a, b2Vec2 velocity) const;
+	std::vector<TileCoord> jump_sweep(b2Vec2 a, b2Vec2 b, b2Vec2 velocity) const;
+
+	void build_jump_templates();
+	const JumpTemplate* jump_template(int a, int b) const;
+	b2Vec2 jump_between(int a, int b) const;
+	bool sweep_collides(int a, const JumpTemplate& jump) const;
+	void narrow(Clearance& c, int x, int y) const;
+
+	Edge walk_edge(int a, int b) const;
+	bool jump_edge(int a, int b, Edge& e) const;
+	Edge fall_edge(int a, int b) const;
+	void add_edge(const Edge& e);
+	void find_edges(int node, std::vector<Edge>& found) const;
+
+	EdgeKey edge_key(const std::vector<Node>& from, const Edge& edge) const;
+	void find_changes(const std::vector<Node>& old_nodes, const std::vector<Edge>& old_edges, const std::vector< std::vector<int> >& old_tile_nodes);
+
+	void generate_profile_times();
+	void generate_landmarks();
+	void generate_components();
+	const std::vector<int>& search_reach(int component, int target) const;
+	std::vector<float> travel_times(int source, bool reverse) const;
 
 public:
 	float gravity = 10.0;
 	float max_jump_dist = 10.0;
+	int landmark_count = 8;
+	int max_reach_components = 4096; // Past this reach is searched for per query instead of stored in count^2 bits
+	AgentProfile profile; // Agent used when preprocessing the mesh
 
-	NavMesh(Tilemap& tilemap);
+	NavMesh(const Tilemap& tilemap, bool build = true); // Without build the mesh is empty until generate() or load()
 
 	void generate();
-	void render() const;
+	void save(std::ostream& out) const;
+	bool load(std::istream& in);
+#ifndef NAV_HEADLESS
+	void render(Rectangle view) const;
+#endif
 	const Node& get_closest(b2Vec2 position) const;
 	bool valid() const;
+	const NavMeshChanges& get_changes() const;
+	int node_at(b2Vec2 position) const;
+
+	bool traversable(int edge, EdgeDirection direction, const AgentProfile& agent) const;
+	float travel_time(int edge, EdgeDirection direction, const AgentProfile& agent) const;
+	float heuristic(int node, int goal) const;
+	float projectile(b2Vec2 v, b2Vec2 p0, float x) const;
+
+	float profile_time(int edge, EdgeDirection direction) const {
+		return profile_times[2 * edge + static_cast<int>(direction)];
+	}
+
+	// Components are only built for the preprocessing profile, planners for any other must not use these
+	bool reachable(int from, int to) const;
+	int nearest_reachable(int from, b2Vec2 position) const;
 
 	friend class Pathfinder;
+	friend class FlowMap;
+	friend class Replanner;
 };
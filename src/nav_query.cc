@@ -0,0 +1,187 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <box2d/box2d.h>
+
+#include "physics.hh"
+#include "tilemap.hh"
+#include "nav_mesh.hh"
+#include "pathfinder.hh"
+#include "jobs.hh"
+
+using namespace std;
+
+// Headless batch path queries for checking maps offline
+//
+// usage: nav_query <map> [-m <mesh>] [-g] [-t] [queries]
+//
+// The map is text, one line per row of tiles with '#' for walls. If a mesh file is given it is
+// loaded when it was saved from the same tiles, otherwise the mesh is generated and saved to it.
+// Queries are read from the file or stdin, one per line as "from_x from_y to_x to_y" in world
+// units. Each result is written on its own line in query order as
+// "<line> <ok|fallback> <time> <segments> x y ..." with the start of every segment, fallback when the
+// goal can't be reached and the path ends at the closest node that can instead.
+// -g plans with the generic runtime policies instead of the mesh's tables, -t writes timings to stderr.
+
+const int batch_size = 4096; // Queries read and planned at once
+
+struct Query {
+	int line;
+	b2Vec2 from, to;
+};
+
+static bool read_rows(const char* file, vector<string>& rows) {
+	ifstream in(file);
+	if (!in) return false;
+
+	string row;
+	while ( getline(in, row) ) rows.push_back(row);
+	return !rows.empty();
+}
+
+static string format_result(const Query& query, const Path& path, const SearchStats& stats) {
+	ostringstream out;
+	out.precision(3);
+	out << fixed;
+
+	out << query.line << (stats.fallback? " fallback " : " ok ") << stats.cost << ' ' << path.size();
+	for (const auto& segment : path) out << ' ' << segment.start.x << ' ' << segment.start.y;
+	out << '\n';
+
+	return out.str();
+}
+
+int main(int argc, char const *argv[]) {
+	const char* map_file = nullptr;
+	const char* mesh_file = nullptr;
+	const char* query_file = nullptr;
+	bool generic = false;
+	bool timing = false;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-m" && i + 1 < argc) mesh_file = argv[++i];
+		else if (arg == "-g") generic = true;
+		else if (arg == "-t") timing = true;
+		else if (!map_file) map_file = argv[i];
+		else if (!query_file) query_file = argv[i];
+	}
+
+	if (!map_file) {
+		cerr << "usage: nav_query <map> [-m <mesh>] [-g] [-t] [queries]" << endl;
+		return 1;
+	}
+
+	vector<string> rows;
+	if ( !read_rows(map_file, rows) ) {
+		cerr << "nav_query: can't read map " << map_file << endl;
+		return 1;
+	}
+
+	auto world = init_world();
+	Tilemap tilemap(world, rows);
+	NavMesh nav_mesh(tilemap, false);
+
+	// Use the saved mesh if it still matches the map
+	bool loaded = false;
+	if (mesh_file) {
+		ifstream in(mesh_file, ios::binary);
+		loaded = in && nav_mesh.load(in);
+	}
+
+	if (!loaded) {
+		nav_mesh.generate();
+
+		if (mesh_file) {
+			ofstream out(mesh_file, ios::binary);
+			nav_mesh.save(out);
+			if (!out) cerr << "nav_query: can't write mesh " << mesh_file << endl;
+		}
+	}
+
+	if ( !nav_mesh.valid() ) {
+		cerr << "nav_query: map has nowhere to stand" << endl;
+		return 1;
+	}
+
+	ifstream query_stream;
+	if (query_file) {
+		query_stream.open(query_file);
+		if (!query_stream) {
+			cerr << "nav_query: can't read queries " << query_file << endl;
+			return 1;
+		}
+	}
+	istream& in = query_file? query_stream : cin;
+
+	// Pathfinders keep per search state so each worker gets its own
+	vector< unique_ptr<Pathfinder> > pathfinders;
+	for (int i = 0; i < jobs.worker_count(); i++) {
+		pathfinders.push_back( make_unique<Pathfinder>(AgentProfile(), nav_mesh) );
+		pathfinders.back()->specialize = !generic;
+	}
+
+	vector<Query> queries;
+	vector<string> results;
+	string line;
+	int line_number = 0;
+	bool done = false;
+
+	long planned = 0;
+	chrono::duration<double> planning(0);
+
+	while (!done) {
+		// Read a batch of queries, skipping lines that don't parse
+		queries.clear();
+		while ( queries.size() < batch_size ) {
+			if ( !getline(in, line) ) {
+				done = true;
+				break;
+			}
+			line_number++;
+
+			Query query = {line_number};
+			istringstream fields(line);
+			if ( fields >> query.from.x >> query.from.y >> query.to.x >> query.to.y ) queries.push_back(query);
+		}
+
+		if ( queries.empty() ) continue;
+
+		// Plan the batch across all workers then write it out in order
+		results.assign( queries.size(), string() );
+		auto start = chrono::steady_clock::now();
+
+		jobs.wait( jobs.parallel_for(queries.size(), 16, [&](int start, int end, int worker) {
+			for (int i = start; i < end; i++) {
+				SearchStats stats;
+				Path path = pathfinders[worker]->find_path(queries[i].from, queries[i].to, stats);
+				results[i] = format_result(queries[i], path, stats);
+			}
+		}) );
+
+		planning += chrono::steady_clock::now() - start;
+		planned += queries.size();
+
+		for (const auto& result : results) cout << result;
+	}
+
+	cout.flush();
+
+	if (timing) {
+		SearchTotals totals;
+		for (const auto& pathfinder : pathfinders) {
+			totals.queries += pathfinder->totals.queries;
+			totals.expanded += pathfinder->totals.expanded;
+		}
+
+		cerr << planned << " queries in " << planning.count() << "s, " << planned / max(planning.count(), 1e-9) << " per second, "
+			<< totals.expanded / max(totals.queries, 1) << " nodes expanded per query" << endl;
+	}
+
+	b2DestroyWorld(world);
+	return 0;
+}
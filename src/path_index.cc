@@ -0,0 +1,73 @@
+#include <algorithm>
+
+#include "path_index.hh"
+#include "agent.hh"
+
+using namespace std;
+
+PathIndex::PathIndex(const Tilemap& tilemap) : tilemap(tilemap) {
+
+}
+
+long long PathIndex::key(const EdgeKey& edge) const {
+	return (long long) edge.a << 32 | edge.b;
+}
+
+long long PathIndex::key(b2Vec2 a, b2Vec2 b) const {
+	TileCoord ta = a;
+	TileCoord tb = b;
+
+	int tile_a = tilemap.tile_index(ta.x, ta.y);
+	int tile_b = tilemap.tile_index(tb.x, tb.y);
+
+	return key( EdgeKey { min(tile_a, tile_b), max(tile_a, tile_b) } );
+}
+
+void PathIndex::track(Agent& agent) {
+	// Call whenever the agent gets a new path
+	untrack(agent);
+
+	auto& used = keys[&agent];
+	for (int i = 0; i + 1 < agent.path.size(); i++) {
+		long long k = key(agent.path[i].start, agent.path[i+1].start);
+
+		used.push_back(k);
+		agents[k].push_back(&agent);
+	}
+}
+
+void PathIndex::untrack(Agent& agent) {
+	auto used = keys.find(&agent);
+	if ( used == keys.end() ) return;
+
+	for (const long long k : used->second) {
+		auto& list = agents[k];
+		list.erase( remove(list.begin(), list.end(), &agent), list.end() );
+		if ( list.empty() ) agents.erase(k);
+	}
+
+	keys.erase(used);
+}
+
+int PathIndex::invalidate(const NavMeshChanges& changes) {
+	// Flag agents whose path uses a removed or modified edge, returns how many were flagged
+	if (changes.revision <= revision) return 0; // Already applied
+	revision = changes.revision;
+
+	int flagged = 0;
+
+	for (const auto* list : {&changes.removed, &changes.modified})
+	for (const auto& edge : *list) {
+		auto found = agents.find( key(edge) );
+		if ( found == agents.end() ) continue;
+
+		for (auto* agent : found->second) {
+			if (agent->needs_replan) continue;
+
+			agent->needs_replan = true;
+			flagged++;
+		}
+	}
+
+	return flagged;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+#include "nav_mesh.hh"
+
+class Agent;
+
+// Reverse index from nav mesh edges to the agents whose paths use them
+// Agents must be untracked before they are destroyed
+class PathIndex {
+private:
+	const Tilemap& tilemap;
+	unsigned int revision = 0; // Last change set applied
+
+	std::unordered_map< long long, std::vector<Agent*> > agents; // Agents using each edge
+	std::unordered_map< Agent*, std::vector<long long> > keys; // Edges used by each agent
+
+	long long key(const EdgeKey& edge) const;
+	long long key(b2Vec2 a, b2Vec2 b) const;
+
+public:
+	PathIndex(const Tilemap& tilemap);
+
+	void track(Agent& agent);
+	void untrack(Agent& agent);
+	int invalidate(const NavMeshChanges& changes);
+};
@@ -1,207 +1,555 @@
 #include <iostream>
 #include <algorithm>
+#include <cassert>
+#ifndef NAV_HEADLESS
 #include <raylib.h>
+#endif
 
 #include "pathfinder.hh"
 #include "agent.hh"
+#include "jobs.hh"
+#include "util.hh"
 
 using namespace std;
 
-Pathfinder::Pathfinder(Agent& agent, NavMesh& nav_mesh) : agent(agent), nav_mesh(nav_mesh) {
+const float ground_tolerance = 0.05; // How far from the floor and how fast vertically an agent can be and still stand on it
+
+// Search policies, the table ones only hold for the profile the mesh was preprocessed with
+
+struct TableCost {
+	const NavMesh& nav_mesh;
+	float operator()(int edge, EdgeDirection direction) const { return nav_mesh.profile_time(edge, direction); }
+};
+
+struct TableFilter {
+	const NavMesh& nav_mesh;
+	bool operator()(int edge, EdgeDirection direction) const { return nav_mesh.profile_time(edge, direction) < INFINITY; }
+};
+
+struct ProfileCost {
+	const NavMesh& nav_mesh;
+	const AgentProfile& profile;
+	float operator()(int edge, EdgeDirection direction) const { return nav_mesh.travel_time(edge, direction, profile); }
+};
+
+struct ProfileFilter {
+	const NavMesh& nav_mesh;
+	const AgentProfile& profile;
+	bool operator()(int edge, EdgeDirection direction) const { return nav_mesh.traversable(edge, direction, profile); }
+};
+
+// The lowest estimate over all goals stays a lower bound on the time to the nearest one
+struct LandmarkHeuristic {
+	const NavMesh& nav_mesh;
+	const vector<int>& targets;
+
+	float operator()(int node, float) const {
+		float h = INFINITY;
+		for (const int goal : targets) h = min( h, nav_mesh.heuristic(node, goal) );
+		return h;
+	}
+};
+
+// Without landmarks fall back to the linear distance to the nearest goal
+struct DistanceHeuristic {
+	float operator()(int, float distance) const { return distance; }
+};
+
+Pathfinder::Pathfinder(Agent& agent, NavMesh& nav_mesh) : agent(&agent), profile(agent.profile()), nav_mesh(nav_mesh) {
+
+}
+
+Pathfinder::Pathfinder(AgentProfile profile, NavMesh& nav_mesh) : profile(profile), nav_mesh(nav_mesh) {
+
+}
 
+const AgentProfile& Pathfinder::get_profile() const {
+	return profile;
 }
 
-void Pathfinder::render() {
+#ifndef NAV_HEADLESS
+void Pathfinder::render(Rectangle view) {
 	if ( path.size() == 0 ) return;
 
 	for (int i = 0; i < path.size() - 1; i++) {
 		b2Vec2 p0 = path[i].start * world_scale;
 		b2Vec2 p1 = path[i+1].start * world_scale;
+		if ( !in_view(view, p0, p1, 2.0) ) continue;
 
 		DrawCircle(p0.x, p0.y, 2, ORANGE);
 		DrawLine(p0.x, p0.y, p1.x, p1.y, ORANGE);
 	}
 }
 
+void Pathfinder::render_heatmap(Rectangle view) const {
+	if ( expansions.empty() || expansions_revision != nav_mesh.get_changes().revision ) return;
+
+	unsigned int most = *max_element( expansions.begin(), expansions.end() );
+	if (most == 0) return;
+
+	// Color each expanded node from blue to red by how often it was expanded
+	for (int node = 0; node < expansions.size(); node++) {
+		if (expansions[node] == 0) continue;
+
+		b2Vec2 p = nav_mesh.nodes[node].position * world_scale;
+		if ( !in_view(view, p, p, 4.0) ) continue;
+
+		float t = float(expansions[node]) / most;
+		Color color = { (unsigned char)(255*t), 0, (unsigned char)(255*(1-t)), 255 };
+		DrawCircle(p.x, p.y, 4.0, color);
+	}
+}
+#endif
+
 Path Pathfinder::set_goal(b2Vec2 p) {
+	SearchStats stats;
+	return set_goal(p, stats);
+}
+
+Path Pathfinder::set_goal(b2Vec2 p, SearchStats& stats) {
+	assert(agent);
+
+	if ( walk_straight(p, walk) ) {
+		stats = SearchStats();
+		stats.cost = abs(walk.back().start.x - walk.front().start.x) / profile.max_speed;
+		totals.add(stats);
+		return walk;
+	}
+
+	search( agent->get_position(), span(&p, 1), 1, stats );
+	return build_path( context.reached[0] );
+}
+
+Path Pathfinder::find_path(b2Vec2 from, b2Vec2 to, SearchStats& stats) {
+	search( from, span(&to, 1), 1, stats );
+	return build_path( context.reached[0] );
+}
+
+std::vector<Path> Pathfinder::nearest_goals(const std::vector<b2Vec2>& goals, int k) {
+	SearchStats stats;
+	return nearest_goals(goals, k, stats);
+}
+
+std::vector<Path> Pathfinder::nearest_goals(const std::vector<b2Vec2>& goals, int k, SearchStats& stats) {
+	assert(agent);
+	return nearest_goals(agent->get_position(), goals, k, stats);
+}
+
+std::vector<Path> Pathfinder::nearest_goals(b2Vec2 from, const std::vector<b2Vec2>& goals, int k, SearchStats& stats) {
+	if ( goals.empty() ) return {};
+	search(from, goals, k, stats);
+
+	vector<Path> paths;
+	for (const int goal : context.reached) paths.push_back( build_path(goal) );
+
+	return paths;
+}
+
+void Pathfinder::reset_expansions() {
+	// Counts from an older mesh refer to different nodes
+	if ( expansions_revision != nav_mesh.get_changes().revision || expansions.size() != nav_mesh.nodes.size() ) {
+		expansions.assign(nav_mesh.nodes.size(), 0);
+		expansions_revision = nav_mesh.get_changes().revision;
+	}
+}
+
+void SearchContext::begin(int node_count, int edge_count) {
+	// A new mesh size or a wrapped generation invalidates every stamp
+	if ( entries.size() != node_count || ++generation == 0 ) {
+		entries.assign( node_count, Entry() );
+		generation = 1;
+	}
+
+	// Each relaxed edge pushes at most once, plus the start
+	open.clear();
+	open.reserve(2 * edge_count + 1);
+	targets.clear();
+	reached.clear();
+}
+
+void Pathfinder::search(b2Vec2 from, std::span<const b2Vec2> goals, int k, SearchStats& stats, int budget) {
 	path.clear();
+	stats = SearchStats();
+
+	reset_expansions();
+	context.begin( nav_mesh.nodes.size(), nav_mesh.edges.size() );
+	const unsigned int generation = context.generation;
+	auto& entries = context.entries;
+
+	int start_node = nav_mesh.closest(from);
+
+	// Landmarks and components are only valid for the profile the mesh was preprocessed with
+	bool preprocessed = nav_mesh.profile == profile;
+
+	auto target = [&](int goal) {
+		if (entries[goal].target == generation) return;
+		entries[goal].target = generation;
+		context.targets.push_back(goal);
+	};
 
-	PathNode start;
-	int start_node = nav_mesh.closest( agent.get_position() );
-	int goal;
+	// Goals that can't be reached are dropped so the search never explores everything looking for them
+	for (const b2Vec2 p : goals) {
+		int goal = nav_mesh.closest(p);
+		if ( !preprocessed || nav_mesh.reachable(start_node, goal) ) target(goal);
+	}
+
+	// If none of them can be reached head for the closest nodes that can instead
+	if ( context.targets.empty() ) {
+		for (const b2Vec2 p : goals) target( nav_mesh.nearest_reachable(start_node, p) );
+		stats.fallback = true;
+	}
+
+	k = clamp<int>(k, 1, context.targets.size());
+
+	// Pick the policies once per query so the search loop has no runtime switches left in it
+	if (preprocessed && specialize) expand( start_node, goals, k, stats, budget, TableCost {nav_mesh}, TableFilter {nav_mesh}, LandmarkHeuristic {nav_mesh, context.targets} );
+	else if (preprocessed) expand( start_node, goals, k, stats, budget, ProfileCost {nav_mesh, profile}, ProfileFilter {nav_mesh, profile}, LandmarkHeuristic {nav_mesh, context.targets} );
+	else expand( start_node, goals, k, stats, budget, ProfileCost {nav_mesh, profile}, ProfileFilter {nav_mesh, profile}, DistanceHeuristic {} );
+}
+
+template <typename Cost, typename Filter, typename Heuristic>
+void Pathfinder::expand(int start, std::span<const b2Vec2> goals, int k, SearchStats& stats, int budget, const Cost& cost, const Filter& filter, const Heuristic& heuristic) {
+	const unsigned int generation = context.generation;
+	auto& entries = context.entries;
+	auto& open = context.open;
+
+	auto goal_distance = [&](b2Vec2 position) {
+		float d = INFINITY;
+		for (const b2Vec2 p : goals) d = min( d, b2Distance(position, p) );
+		return d;
+	};
+
+	auto later = [](const SearchContext::Open& a, const SearchContext::Open& b) {
+		return a.priority > b.priority;
+	};
+
+	// Open a node or lower its cost, the old heap entry is left behind and skipped when popped
+	auto visit = [&](int node, int parent, int edge, float time) {
+		SearchContext::Entry& entry = entries[node];
+
+		if (entry.visited != generation) {
+			entry.visited = generation;
+			entry.closed = false;
+			entry.distance = goal_distance(nav_mesh.nodes[node].position);
+			entry.estimate = heuristic(node, entry.distance);
+		}
+		else if (entry.closed || time >= entry.cost) return;
 
-	start = PathNode { start_node, -1, -1, 0.0, b2Distance(agent.get_position(), p) };
-	goal = nav_mesh.closest(p);
+		entry.parent = parent;
+		entry.edge = edge;
+		entry.cost = time;
 
-	std::vector<PathNode> open;
-	std::vector<PathNode> closed;
-	bool goal_reached = false;
+		open.push_back( SearchContext::Open {time + entry.estimate, time, node} );
+		push_heap(open.begin(), open.end(), later);
+		stats.peak_open = max<int>( stats.peak_open, open.size() );
+	};
 
-	open.reserve( nav_mesh.nodes.size() ); closed.reserve( nav_mesh.nodes.size() );
+	visit(start, -1, -1, 0.0);
 
-	open.push_back(start);
+	int closest = -1; // Closed node nearest to any goal, used if none are reached
+	float closest_distance = INFINITY;
 
-	// A* search algorithm
+	// A* search algorithm, goals come off the open heap in order of travel time
 	while ( !open.empty() ) {
-		// Find the cheapest node
-		int cheapest = lowest_cost(open);
+		pop_heap(open.begin(), open.end(), later);
+		SearchContext::Open top = open.back();
+		open.pop_back();
 
-		// Move cheapest to closed
-		closed.push_back( open[cheapest] );
-		open.erase(open.begin() + cheapest);
-		int current = closed.size() - 1; // Index of current in closed list
+		SearchContext::Entry& current = entries[top.node];
+		if (current.closed || top.cost != current.cost) continue; // Stale entry
+		if (budget > 0 && stats.expanded == budget) break; // Out of nodes to spend, 0 is no limit
 
-		// If the goal has been reached search is complete
-		if (closed[current].node == goal) {
-			goal_reached = true;
-			break;
+		current.closed = true;
+		stats.expanded++;
+		expansions[top.node]++;
+
+		if (current.distance <= closest_distance) {
+			closest_distance = current.distance;
+			closest = top.node;
+		}
+
+		// Search is complete once k goals have been reached
+		if (current.target == generation) {
+			context.reached.push_back(top.node);
+			if (context.reached.size() == k) break;
 		}
 
 		// Search through connected nodes
-		auto neighbors = get_adjacent(closed[current].node); // Get adjacent to current
+		for (const int edge : nav_mesh.nodes[top.node].edges) {
+			const Edge& e = nav_mesh.edges[edge];
+			EdgeDirection direction = top.node == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+			if ( !filter(edge, direction) ) continue;
 
-		for (auto node : neighbors) {
-			if ( in_list(open, node) ) continue;
-			if ( in_list(closed, node) ) continue;
+			stats.relaxed++;
 
-			node.parent = current;
-			node.distance = b2Distance(nav_mesh.nodes[node.node].position, p);
-			node.cost += closed[current].cost;
-			open.push_back(node);
+			int other = direction == EdgeDirection::A_TO_B? e.b : e.a;
+			visit( other, top.node, edge, current.cost + cost(edge, direction) );
 		}
 	}
 
-	// Build the path
-	int end = goal_reached? closed.size() - 1 : [&]{
-		// Find node closest to the goal
-		float dist = INFINITY;
-		int n = -1; // Index of closest node
+	// No goal reached, fall back to the node closest to any of them
+	if ( context.reached.empty() ) {
+		context.reached.push_back(closest);
+		stats.fallback = true;
+	}
 
-		for (int i = 0; i < closed.size(); i++) {
-			if (closed[i].distance > dist) continue; // Move on if this is farther than dist
+	stats.cost = entries[ context.reached[0] ].cost;
+	totals.add(stats);
+}
 
-			dist = closed[i].distance;
-			n = i;
+Path Pathfinder::find_path(b2Vec2 from, b2Vec2 to, ReservationTable& reservations, int id, SearchStats& stats) {
+	// Space-time A* that avoids nodes other agents have reserved then reserves the path found
+	path.clear();
+	stats = SearchStats();
+
+	reset_expansions();
+
+	const int count = nav_mesh.nodes.size();
+	const int layers = reservations.get_window() + 1; // The last layer is past the window, where nothing is reserved
+	const int now = reservations.current_step();
+
+	timed_context.begin( count * layers, (nav_mesh.edges.size() + count) * layers );
+	const unsigned int generation = timed_context.generation;
+	auto& entries = timed_context.entries;
+	auto& open = timed_context.open;
+
+	int start_node = nav_mesh.closest(from);
+	int goal = nav_mesh.closest(to);
+
+	bool preprocessed = nav_mesh.profile == profile;
+	if ( preprocessed && !nav_mesh.reachable(start_node, goal) ) {
+		goal = nav_mesh.nearest_reachable(start_node, to);
+		stats.fallback = true;
+	}
+
+	auto edge_time = [&](int edge, EdgeDirection direction) {
+		if (preprocessed && specialize) return nav_mesh.profile_time(edge, direction);
+		return nav_mesh.traversable(edge, direction, profile)? nav_mesh.travel_time(edge, direction, profile) : INFINITY;
+	};
+
+	auto layer = [&](float time) {
+		return min(reservations.step_at(time) - now, layers - 1);
+	};
+
+	auto free = [&](int node, float time) {
+		return !reservations.reserved( nav_mesh.node_tile(node), reservations.step_at(time), id );
+	};
+
+	// Moving from a to b head on into an agent moving from b to a would swap them through each other
+	auto swaps = [&](int a, int b, float leave, float arrive) {
+		int other = reservations.holder( nav_mesh.node_tile(b), reservations.step_at(leave) );
+		return other != -1 && other != id && reservations.holder( nav_mesh.node_tile(a), reservations.step_at(arrive) ) == other;
+	};
+
+	auto later = [](const SearchContext::Open& a, const SearchContext::Open& b) {
+		return a.priority > b.priority;
+	};
+
+	auto visit = [&](int node, int parent, int edge, float time) {
+		int state = layer(time) * count + node;
+		SearchContext::Entry& entry = entries[state];
+
+		if (entry.visited != generation) {
+			entry.visited = generation;
+			entry.closed = false;
+			entry.distance = b2Distance(nav_mesh.nodes[node].position, to);
+			entry.estimate = preprocessed? nav_mesh.heuristic(node, goal) : entry.distance;
 		}
+		else if (entry.closed || time >= entry.cost) return;
 
-		return n;
-	}();
+		entry.parent = parent;
+		entry.edge = edge;
+		entry.cost = time;
 
-	return build_path(closed, end);
-}
+		open.push_back( SearchContext::Open {time + entry.estimate, time, state} );
+		push_heap(open.begin(), open.end(), later);
+		stats.peak_open = max<int>( stats.peak_open, open.size() );
+	};
 
-Path Pathfinder::build_path(const std::vector<PathNode>& list, int goal) {
-	Path p;
+	visit(start_node, -1, -1, 0.0);
 
-	int node = goal;
-	int child = -1; // Previous node evaluated
-	while (true) {
-		int n = list[node].node; // Node index in nav_mesh
+	int end = -1; // State the path ends in
+	int closest = -1;
+	float closest_distance = INFINITY;
 
-		// Get start location
-		b2Vec2 start = nav_mesh.nodes[n].position;
+	while ( !open.empty() ) {
+		pop_heap(open.begin(), open.end(), later);
+		SearchContext::Open top = open.back();
+		open.pop_back();
 
-		// Determine the velocity
-		b2Vec2 velocity = {0,0};
-		if (child != -1) {
-			Edge edge = nav_mesh.edges[ list[child].edge ];
-			velocity = n == edge.a? edge.vel_ab : edge.vel_ba;
+		SearchContext::Entry& current = entries[top.node];
+		if (current.closed || top.cost != current.cost) continue; // Stale entry
+
+		int node = top.node % count;
+		current.closed = true;
+		stats.expanded++;
+		expansions[node]++;
+
+		if (current.distance <= closest_distance) {
+			closest_distance = current.distance;
+			closest = top.node;
 		}
 
-		PathSegment segment = {start,velocity};
+		if (node == goal) {
+			end = top.node;
+			break;
+		}
 
-		p.push_back(segment);
+		// Move along an edge if the node at the other end is free when the agent gets there
+		for (const int edge : nav_mesh.nodes[node].edges) {
+			const Edge& e = nav_mesh.edges[edge];
+			EdgeDirection direction = node == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
 
-		child = node;
-		node = list[node].parent;
-		if (node == -1) break;
+			float time = edge_time(edge, direction);
+			if (time == INFINITY) continue;
+
+			stats.relaxed++;
+
+			int other = direction == EdgeDirection::A_TO_B? e.b : e.a;
+			float arrival = current.cost + time;
+			if ( free(other, arrival) && !swaps(node, other, current.cost, arrival) ) visit(other, top.node, edge, arrival);
+		}
+
+		// Or wait a step in place, only inside the window
+		float wait = current.cost + reservations.get_step_time();
+		if ( top.node < (layers - 1) * count && free(node, wait) ) visit(node, top.node, -1, wait);
 	}
 
-	reverse(p.begin(), p.end());
+	if (end == -1) {
+		end = closest;
+		stats.fallback = true;
+	}
 
-	return p;
-}
+	stats.cost = entries[end].cost;
+	totals.add(stats);
+
+	// Walk back through the states, waits are folded into the segment of the node waited at
+	Path p;
+	int next = -1; // First state at the node after this one
+	int leave = end; // Last state at this node, the agent moves on from here
 
-bool Pathfinder::in_list(const std::vector<PathNode>& list, const PathNode& node) const {
-	for (const auto& n : list)
-		if (n.node == node.node && n.edge == node.edge) return true;
+	for (int state = end; state != -1; state = entries[state].parent) {
+		int parent = entries[state].parent;
+		if ( parent != -1 && parent % count == state % count ) continue; // Waited here, keep looking for the arrival
 
-	return false;
-}
+		int node = state % count;
 
-int Pathfinder::lowest_cost(const std::vector<PathNode>& list) const {
-	float cost = INFINITY;
-	int n = -1; // Index of cheapest node
+		b2Vec2 velocity = {0,0};
+		if (next != -1) {
+			const Edge& edge = nav_mesh.edges[ entries[next].edge ];
+			velocity = node == edge.a? edge.vel_ab : edge.vel_ba;
+		}
 
-	for (int i = 0; i < list.size(); i++) {
-		float c = list[i].cost + list[i].distance;
+		// Hold the node from arriving until the next one is reached, the goal is held to the end of the window
+		int first = reservations.step_at( entries[state].cost );
+		int last = next == -1? now + layers - 1 : reservations.step_at( entries[next].cost );
+		for (int step = first; step < max(last, first + 1); step++) reservations.reserve(nav_mesh.node_tile(node), step, id);
 
-		if (c > cost) continue; // Move on if this isn't cheaper than cost
+		p.push_front( PathSegment {nav_mesh.nodes[node].position, velocity, entries[leave].cost - entries[state].cost} );
 
-		cost = c;
-		n = i;
+		next = state;
+		leave = parent;
 	}
 
-	return n;
+	return p;
 }
 
-float Pathfinder::compute_cost(const int edge, const EdgeDirection direction) const {
-	const Edge& e = nav_mesh.edges[edge];
-	const b2Vec2 pa = nav_mesh.nodes[e.a].position;
-	const b2Vec2 pb = nav_mesh.nodes[e.b].position;
+bool Pathfinder::repair() {
+	// Rejoin the agent's remaining path with a search limited to the nodes around it
+	assert(agent);
+	Path& current = agent->path;
+	if ( current.empty() || !nav_mesh.valid() ) return false;
 
-	float dx = abs(pa.x - pb.x);
-	float dy = abs(pa.y - pb.y);
+	vector<b2Vec2> rejoin;
+	for (const auto& segment : current) rejoin.push_back(segment.start);
 
-	float time, vx;
+	SearchStats stats;
+	search(agent->get_position(), rejoin, 1, stats, repair_budget);
+	if (stats.fallback) return false;
 
-	switch (e.type) {
-		case EdgeType::WALK:
-			time = dx / agent.max_speed;
-			break;
-		case EdgeType::JUMP:
-			vx = direction == EdgeDirection::A_TO_B? e.vel_ab.x : e.vel_ba.x;
-			time = dx / abs(vx) * 5.0;
-			break;
-		case EdgeType::FALL:
-			time = sqrt( 2 *  dy/abs(nav_mesh.gravity) );
-			break;
-	}
+	// Find where the repair meets the old path, goals redirected off the path don't count
+	b2Vec2 joined = nav_mesh.nodes[ context.reached[0] ].position;
+	auto meet = find_if( current.begin(), current.end(), [&](const PathSegment& segment) {
+		return segment.start.x == joined.x && segment.start.y == joined.y;
+	});
+	if ( meet == current.end() ) return false;
+
+	Path repaired = build_path( context.reached[0] );
+	repaired.back().velocity = meet->velocity;
+	repaired.insert( repaired.end(), meet + 1, current.end() );
+
+	current = repaired;
+	return true;
+}
+
+std::vector<Path> Pathfinder::set_goals(const std::vector<Pathfinder*>& pathfinders, const std::vector<b2Vec2>& goals) {
+	// Plan each pathfinder to its goal on the job system, the nav mesh must not change until this returns
+	vector<Path> paths( pathfinders.size() );
+
+	jobs.wait( jobs.parallel_for(pathfinders.size(), 1, [&](int start, int end, int) {
+		for (int i = start; i < end; i++) paths[i] = pathfinders[i]->set_goal(goals[i]);
+	}) );
 
-	return time;
+	return paths;
 }
 
-std::vector<Pathfinder::PathNode> Pathfinder::get_adjacent(const int node) const {
-	vector<PathNode> adjacent;
+void SearchTotals::add(const SearchStats& stats) {
+	queries++;
+	expanded += stats.expanded;
+	relaxed += stats.relaxed;
+	peak_open = max(peak_open, stats.peak_open);
+	if (stats.fallback) fallbacks++;
+}
+
+bool Pathfinder::walk_straight(b2Vec2 to, Path& walk) const {
+	// A goal along the floor the agent stands on with nothing in the way doesn't need a search
+	if ( !nav_mesh.valid() ) return false;
+	const Tilemap& tilemap = nav_mesh.tilemap;
 
-	for (const int edge : nav_mesh.nodes[node].edges) {
-		EdgeDirection direction = node == nav_mesh.edges[edge].a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
-		if ( !can_connect(edge, direction) ) continue;
+	b2Vec2 from = agent->get_position();
+	float feet = from.y + agent->height/2.0;
+	int y = floor(feet - 0.5); // Row of the tile stood in
+	int x0 = floor(from.x), x1 = floor(to.x);
+	if ( floor(to.y) != y ) return false;
 
-		int other = direction == EdgeDirection::A_TO_B? nav_mesh.edges[edge].b : nav_mesh.edges[edge].a;
+	// Only from standing on the floor, a jumping or falling agent has to land somewhere first
+	if ( abs(feet - (y + 1)) > ground_tolerance || abs( agent->get_velocity().y ) > ground_tolerance ) return false;
 
-		PathNode new_node;
-		new_node.node = other;
-		new_node.edge = edge;
-		new_node.cost = compute_cost(edge, direction);
-		adjacent.push_back(new_node);
+	// Every tile along the way needs a node with room for the agent, the same test a walk edge's clearance gets
+	int step = x1 < x0? -1 : 1;
+	for (int x = x0; x != x1 + step; x += step) {
+		if ( nav_mesh.tile_node(x, y) == -1 ) return false;
+
+		Clearance c = tilemap.clearance(x, y);
+		if (c.up < profile.height || c.across < profile.width) return false;
 	}
 
-	return adjacent;
+	// One segment per node like a searched path, so edits to the floor are still tracked
+	walk.clear();
+	for (int x = x0; x != x1 + step; x += step) {
+		const Node& node = nav_mesh.nodes[ nav_mesh.tile_node(x, y) ];
+		b2Vec2 velocity = x == x1? b2Vec2 {0, 0} : b2Vec2 {float(step), 0};
+		walk.push_back( PathSegment {node.position, velocity} );
+	}
+
+	return true;
 }
 
-bool Pathfinder::can_connect(const int edge, const EdgeDirection direction) const {
-	const Edge& e = nav_mesh.edges[edge];
+Path Pathfinder::build_path(int goal) const {
+	Path p;
 
-	if (direction == EdgeDirection::A_TO_B) {
-		if (abs(e.vel_ab.x) <= agent.max_speed && abs(e.vel_ab.y) <= agent.jump_speed)
-			return true;
-	}
+	int child = -1; // Previous node evaluated
+	for (int node = goal; node != -1; node = context.entries[node].parent) {
+		// Determine the velocity
+		b2Vec2 velocity = {0,0};
+		if (child != -1) {
+			const Edge& edge = nav_mesh.edges[ context.entries[child].edge ];
+			velocity = node == edge.a? edge.vel_ab : edge.vel_ba;
+		}
 
-	else if (direction == EdgeDirection::B_TO_A) {
-		if (abs(e.vel_ba.x) <= agent.max_speed && abs(e.vel_ba.y) <= agent.jump_speed)
-			return true;
+		p.push_front( PathSegment {nav_mesh.nodes[node].position, velocity} );
+		child = node;
 	}
 
-	return false;
+	return p;
 }
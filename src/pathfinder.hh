@@ -2,43 +2,114 @@
 
 #include <vector>
 #include <deque>
+#include <span>
 
 #include "nav_mesh.hh"
+#include "reservation_table.hh"
 
 class Agent;
 
 struct PathSegment {
 	b2Vec2 start;
 	b2Vec2 velocity;
+	float wait = 0.0; // Time to hold at start before leaving, so reserved nodes ahead can clear
 };
 
 typedef std::deque<PathSegment> Path;
 
+struct SearchStats {
+	int expanded = 0; // Nodes moved to the closed list
+	int peak_open = 0; // Largest size of the open heap, including entries that were since improved on
+	int relaxed = 0; // Edges followed from expanded nodes
+	bool fallback = false; // The goal couldn't be reached, or wasn't within the budget, so the path ends at the closest node instead
+	float cost = 0.0; // Travel time along the first path returned
+};
+
+struct SearchTotals {
+	int queries = 0;
+	long expanded = 0;
+	long relaxed = 0;
+	int peak_open = 0; // Largest over all queries
+	int fallbacks = 0;
+
+	void add(const SearchStats& stats);
+};
+
+// Per node search state kept between queries so searching doesn't allocate once warmed up
+// An entry is only valid while its stamp matches the current generation, so nothing has to be cleared
+struct SearchContext {
+	struct Entry {
+		unsigned int visited = 0; // Generation the node was last reached in
+		unsigned int target = 0; // Generation the node was last a goal in
+		bool closed;
+		int parent; // Node this was reached from, -1 for the start
+		int edge; // Edge by which this connects to parent
+		float cost; // Time to get to this node from start
+		float distance; // Linear distance from the nearest goal
+		float estimate; // Estimated time from this node to the nearest goal
+	};
+
+	struct Open {
+		float priority; // Cost plus estimate
+		float cost; // Cost when pushed, stale once the node is improved on
+		int node;
+	};
+
+	unsigned int generation = 0;
+	std::vector<Entry> entries; // Indexed by nav mesh node
+	std::vector<Open> open; // Binary heap ordered by lowest priority
+	std::vector<int> targets; // Goal nodes, each one only once
+	std::vector<int> reached; // Goal nodes in the order they were closed
+
+	void begin(int node_count, int edge_count);
+};
+
 class Pathfinder {
 private:
-	Agent& agent;
+	Agent* agent = nullptr; // Only set when planning for an agent in the world
+	AgentProfile profile;
 	NavMesh& nav_mesh;
 
-	struct PathNode {
-		int node; // Index of node in nav_mesh
-		int parent; // Index of parent in closed list
-		int edge; // Edge by which node connects to parent
-		float cost; // Time to get to this node from start
-		float distance; // Linear distance from goal
-	};
+	SearchContext context;
+	SearchContext timed_context; // States are a node and a step of the reservation window
 
-	bool in_list(const std::vector<PathNode>& list, const PathNode& node) const;
-	int lowest_cost(const std::vector<PathNode>& list) const;
-	float compute_cost(const int edge, const EdgeDirection direction) const;
-	std::vector<PathNode> get_adjacent(const int node) const;
-	bool can_connect(const int edge, const EdgeDirection direction) const;
-	Path build_path(const std::vector<PathNode>& list, int goal);
+	void reset_expansions();
+	Path build_path(int goal) const;
+	bool walk_straight(b2Vec2 to, Path& walk) const;
+	void search(b2Vec2 from, std::span<const b2Vec2> goals, int k, SearchStats& stats, int budget = 0);
+
+	template <typename Cost, typename Filter, typename Heuristic>
+	void expand(int start, std::span<const b2Vec2> goals, int k, SearchStats& stats, int budget, const Cost& cost, const Filter& filter, const Heuristic& heuristic);
+
+	Path walk; // Reused by set_goal so checking for a straight walk doesn't allocate
+
+	std::vector<unsigned int> expansions; // Times each node was expanded, indexed by nav mesh node
+	unsigned int expansions_revision = 0; // Nav mesh revision the counts belong to
 
 public:
 	Path path;
+	SearchTotals totals;
+	int repair_budget = 64; // Most nodes a repair may expand before giving up
+	bool specialize = true; // Read edge costs from the mesh's tables when planning for its profile, off always uses the runtime policies
 
 	Pathfinder(Agent& agent, NavMesh& nav_mesh);
+	Pathfinder(AgentProfile profile, NavMesh& nav_mesh);
+
+	const AgentProfile& get_profile() const;
+
+	Path find_path(b2Vec2 from, b2Vec2 to, SearchStats& stats);
+	Path find_path(b2Vec2 from, b2Vec2 to, ReservationTable& reservations, int id, SearchStats& stats);
+	std::vector<Path> nearest_goals(b2Vec2 from, const std::vector<b2Vec2>& goals, int k, SearchStats& stats);
 
+	// These plan from the agent's position, so only a pathfinder made with an agent may call them
 	Path set_goal(b2Vec2 p);
-	void render();
+	Path set_goal(b2Vec2 p, SearchStats& stats);
+	std::vector<Path> nearest_goals(const std::vector<b2Vec2>& goals, int k = 1);
+	std::vector<Path> nearest_goals(const std::vector<b2Vec2>& goals, int k, SearchStats& stats);
+	bool repair();
+	static std::vector<Path> set_goals(const std::vector<Pathfinder*>& pathfinders, const std::vector<b2Vec2>& goals);
+#ifndef NAV_HEADLESS
+	void render(Rectangle view);
+	void render_heatmap(Rectangle view) const;
+#endif
 };
@@ -1,15 +1,38 @@
+#ifndef NAV_HEADLESS
 #include <raylib.h>
+#endif
 
 #include "physics.hh"
+#include "jobs.hh"
+
+// Box2D hands its parallel work to the shared job system
+static void* enqueue_task(b2TaskCallback* task, int item_count, int min_range, void* task_context, void* user_context) {
+	auto* pool = static_cast<JobSystem*>(user_context);
+
+	return pool->parallel_for(item_count, min_range, [=](int start, int end, int worker) {
+		task(start, end, worker, task_context);
+	});
+}
+
+static void finish_task(void* user_task, void* user_context) {
+	static_cast<JobSystem*>(user_context)->wait( static_cast<JobSystem::Group*>(user_task) );
+}
 
 b2WorldId init_world() {
 	b2WorldDef world_def = b2DefaultWorldDef();
 	world_def.gravity = b2Vec2 {0.0f, 10.0f};
 
+	world_def.workerCount = jobs.worker_count();
+	world_def.enqueueTask = enqueue_task;
+	world_def.finishTask = finish_task;
+	world_def.userTaskContext = &jobs;
+
 	b2WorldId world = b2CreateWorld(&world_def);
 	return world;
 }
 
+#ifndef NAV_HEADLESS
 void update_world(b2WorldId world) {
 	b2World_Step(world, GetFrameTime(), sub_steps);
 }
+#endif
@@ -6,4 +6,6 @@ const float world_scale = 32.0;
 const int sub_steps = 16;
 
 b2WorldId init_world();
+#ifndef NAV_HEADLESS
 void update_world(b2WorldId world);
+#endif
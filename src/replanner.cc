@@ -0,0 +1,202 @@
+#include <algorithm>
+
+#include "replanner.hh"
+#include "tilemap.hh"
+
+using namespace std;
+
+const float key_epsilon = 1e-4; // Keys closer than this are treated as tied
+
+Replanner::Replanner(NavMesh& nav_mesh, AgentProfile profile) : nav_mesh(nav_mesh), profile(profile) {
+
+}
+
+Path Replanner::set_goal(b2Vec2 from, b2Vec2 to) {
+	int tiles = nav_mesh.tilemap.get_width() * nav_mesh.tilemap.get_height();
+
+	g.assign(tiles, INFINITY);
+	rhs.assign(tiles, INFINITY);
+	keys.assign(tiles, Key {INFINITY, INFINITY});
+	queued.assign(tiles, false);
+	open.clear();
+	km = 0.0;
+
+	if ( !nav_mesh.valid() ) {
+		goal = start = last = -1;
+		return Path();
+	}
+
+	start = last = tile_at(from);
+	goal = tile_at(to);
+
+	rhs[goal] = 0.0;
+	push(goal);
+
+	compute_shortest_path();
+	return build_path();
+}
+
+Path Replanner::replan(b2Vec2 from) {
+	if ( goal == -1 || !nav_mesh.valid() ) return Path();
+
+	// Moving the start lowers every key by at most the heuristic between the old and new start
+	start = tile_at(from);
+	km += heuristic(last, start);
+	last = start;
+
+	compute_shortest_path();
+	return build_path();
+}
+
+Path Replanner::update(const NavMeshChanges& changes) {
+	// Call after the nav mesh is regenerated, only tiles at the ends of changed edges are repaired
+	if (goal == -1) return Path();
+
+	for (const auto* list : {&changes.removed, &changes.modified, &changes.added})
+	for (const auto& edge : *list) {
+		update_vertex(edge.a);
+		update_vertex(edge.b);
+	}
+
+	for (const int tile : changes.tiles) update_vertex(tile);
+
+	// The agent's or goal's node may have been removed with the edit
+	if ( nav_mesh.tile_node(start) == -1 || nav_mesh.tile_node(goal) == -1 ) return Path();
+
+	compute_shortest_path();
+	return build_path();
+}
+
+int Replanner::tile_at(b2Vec2 position) const {
+	return nav_mesh.node_tile( nav_mesh.node_at(position) );
+}
+
+vector<Replanner::Arc> Replanner::get_arcs(int tile, bool reverse) const {
+	// Arcs leaving tile, or arriving at it when reverse is set
+	vector<Arc> result;
+
+	int node = nav_mesh.tile_node(tile);
+	if (node == -1) return result;
+
+	for (const int edge : nav_mesh.nodes[node].edges) {
+		const Edge& e = nav_mesh.edges[edge];
+		int other = node == e.a? e.b : e.a;
+
+		int from = reverse? other : node;
+		EdgeDirection direction = from == e.a? EdgeDirection::A_TO_B : EdgeDirection::B_TO_A;
+		if ( !nav_mesh.traversable(edge, direction, profile) ) continue;
+
+		result.push_back( Arc { nav_mesh.node_tile(other), edge, nav_mesh.travel_time(edge, direction, profile) } );
+	}
+
+	return result;
+}
+
+float Replanner::heuristic(int a, int b) const {
+	// No edge is faster than this per tile moved horizontally, so the estimate is consistent
+	// It's shaded down a little so rounding along walks, where it is tight, can't make it overestimate
+	float rate = min( 1.0f / profile.max_speed, sqrt( 2.0f / abs(nav_mesh.gravity) ) ) * (1.0f - 1e-4f);
+
+	auto [ax, ay] = nav_mesh.tilemap.tile_coord(a);
+	auto [bx, by] = nav_mesh.tilemap.tile_coord(b);
+
+	return abs(ax - bx) * rate;
+}
+
+float Replanner::cost() const {
+	// Time from the start to the goal, infinite if it can't be reached
+	if (goal == -1 || start == -1) return INFINITY;
+	return rhs[start];
+}
+
+Replanner::Key Replanner::compute_key(int tile) const {
+	float cost = min(g[tile], rhs[tile]);
+	return Key {cost + heuristic(start, tile) + km, cost};
+}
+
+void Replanner::push(int tile) {
+	keys[tile] = compute_key(tile);
+	queued[tile] = true;
+	open.insert( {keys[tile], tile} );
+}
+
+void Replanner::remove(int tile) {
+	if ( !queued[tile] ) return;
+
+	open.erase( {keys[tile], tile} );
+	queued[tile] = false;
+}
+
+void Replanner::update_vertex(int tile) {
+	if (tile != goal) {
+		rhs[tile] = INFINITY;
+		for (const auto& arc : get_arcs(tile, false))
+			rhs[tile] = min(rhs[tile], arc.cost + g[arc.tile]);
+	}
+
+	remove(tile);
+	if (g[tile] != rhs[tile]) push(tile);
+}
+
+void Replanner::compute_shortest_path() {
+	// Keys within key_epsilon of the start's are processed too, rounding shouldn't decide whether a tile is settled
+	while ( !open.empty() && ( open.begin()->first.first < compute_key(start).first + key_epsilon || rhs[start] != g[start] ) ) {
+		auto [old_key, tile] = *open.begin();
+		Key new_key = compute_key(tile);
+
+		// Key is out of date from the start moving
+		if (old_key < new_key) {
+			remove(tile);
+			push(tile);
+		}
+
+		// Overconsistent, settle it
+		else if (g[tile] > rhs[tile]) {
+			g[tile] = rhs[tile];
+			remove(tile);
+
+			for (const auto& arc : get_arcs(tile, true)) update_vertex(arc.tile);
+		}
+
+		// Underconsistent, raise it and let its predecessors find another route
+		else {
+			g[tile] = INFINITY;
+			update_vertex(tile);
+
+			for (const auto& arc : get_arcs(tile, true)) update_vertex(arc.tile);
+		}
+	}
+}
+
+Path Replanner::build_path() const {
+	Path path;
+	if (rhs[start] == INFINITY) return path; // Goal can't be reached
+
+	// Follow the cheapest arc from each tile until the goal
+	int tile = start;
+	for (int steps = 0; tile != goal && steps < g.size(); steps++) {
+		Arc best = {-1, -1, INFINITY};
+		float best_cost = INFINITY;
+
+		for (const auto& arc : get_arcs(tile, false)) {
+			if (arc.cost + g[arc.tile] >= best_cost) continue;
+
+			best_cost = arc.cost + g[arc.tile];
+			best = arc;
+		}
+
+		if (best.tile == -1) return Path();
+
+		int node = nav_mesh.tile_node(tile);
+		const Edge& e = nav_mesh.edges[best.edge];
+		b2Vec2 velocity = node == e.a? e.vel_ab : e.vel_ba;
+
+		path.push_back( {nav_mesh.nodes[node].position, velocity} );
+		tile = best.tile;
+	}
+
+	if (tile != goal) return Path();
+
+	path.push_back( {nav_mesh.nodes[ nav_mesh.tile_node(goal) ].position, {0,0}} );
+	return path;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <set>
+
+#include "nav_mesh.hh"
+#include "pathfinder.hh"
+
+// D* Lite planner for a long lived goal
+// Search state is kept per tile so it survives the nav mesh being regenerated
+class Replanner {
+private:
+	NavMesh& nav_mesh;
+	AgentProfile profile;
+
+	typedef std::pair<float, float> Key;
+
+	struct Arc {
+		int tile; // Tile of the node at the other end
+		int edge; // Edge in nav_mesh
+		float cost; // Time to travel the edge
+	};
+
+	int goal = -1; // Tile the search starts from
+	int start = -1; // Tile the agent is in
+	int last = -1; // Start tile when keys were last corrected
+	float km = 0.0; // Key modifier for start movement
+
+	std::vector<float> g; // Time to goal
+	std::vector<float> rhs; // One step lookahead of g
+	std::vector<Key> keys; // Key of each queued tile
+	std::vector<bool> queued;
+	std::set< std::pair<Key, int> > open;
+
+	int tile_at(b2Vec2 position) const;
+	std::vector<Arc> get_arcs(int tile, bool reverse) const;
+	float heuristic(int a, int b) const;
+	Key compute_key(int tile) const;
+
+	void push(int tile);
+	void remove(int tile);
+	void update_vertex(int tile);
+	void compute_shortest_path();
+	Path build_path() const;
+
+public:
+	Replanner(NavMesh& nav_mesh, AgentProfile profile = AgentProfile());
+
+	Path set_goal(b2Vec2 from, b2Vec2 to);
+	Path replan(b2Vec2 from);
+	Path update(const NavMeshChanges& changes);
+	float cost() const;
+};
@@ -0,0 +1,66 @@
+#include <cmath>
+
+#include "reservation_table.hh"
+
+using namespace std;
+
+ReservationTable::ReservationTable(float step_time, int window) : step_time(step_time), window(window), slots(window) {
+
+}
+
+float ReservationTable::get_step_time() const {
+	return step_time;
+}
+
+int ReservationTable::get_window() const {
+	return window;
+}
+
+int ReservationTable::current_step() const {
+	return now;
+}
+
+int ReservationTable::step_at(float delay) const {
+	// Step a time delay seconds from now falls in
+	return floor( (time + delay) / step_time );
+}
+
+void ReservationTable::advance(float dt) {
+	time += dt;
+	int step = step_at(0.0);
+
+	// Steps that have passed free their slots for the end of the window
+	for (; now < step; now++) slots[now % window].clear();
+}
+
+int ReservationTable::holder(int tile, int step) const {
+	// Agent holding tile at step or -1, nothing outside the window is reserved
+	if (step < now || step >= now + window) return -1;
+
+	const auto& slot = slots[step % window];
+	auto holder = slot.find(tile);
+	return holder != slot.end()? holder->second : -1;
+}
+
+bool ReservationTable::reserved(int tile, int step, int agent) const {
+	int held = holder(tile, step);
+	return held != -1 && held != agent;
+}
+
+void ReservationTable::reserve(int tile, int step, int agent) {
+	if (step < now || step >= now + window) return;
+	slots[step % window].emplace(tile, agent); // First come keeps it
+}
+
+void ReservationTable::release(int agent) {
+	for (auto& slot : slots) {
+		for (auto i = slot.begin(); i != slot.end();) {
+			if (i->second == agent) i = slot.erase(i);
+			else i++;
+		}
+	}
+}
+
+void ReservationTable::clear() {
+	for (auto& slot : slots) slot.clear();
+}
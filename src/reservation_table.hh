@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+
+// Space-time reservations of nav mesh nodes for cooperative planning
+// Time is split into steps and only the next window of steps is kept, nodes are keyed by their tile
+// so reservations survive the nav mesh being regenerated
+class ReservationTable {
+private:
+	float step_time;
+	int window;
+
+	float time = 0.0; // Seconds since the table was made
+	int now = 0; // Step time falls in
+	std::vector< std::unordered_map<int, int> > slots; // Agent holding each tile, slot step % window holds step
+
+public:
+	ReservationTable(float step_time = 0.25, int window = 32);
+
+	float get_step_time() const;
+	int get_window() const;
+	int current_step() const;
+	int step_at(float delay) const;
+
+	void advance(float dt);
+	int holder(int tile, int step) const;
+	bool reserved(int tile, int step, int agent) const;
+	void reserve(int tile, int step, int agent);
+	void release(int agent);
+	void clear();
+};
@@ -1,22 +1,45 @@
 #include <algorithm>
+#include <utility>
+#include <cmath>
 
 #include "tilemap.hh"
+#include "jobs.hh"
+#include "util.hh"
 
 Tilemap::Tilemap(b2WorldId world, unsigned int width, unsigned int height) {
-	tiles = new Tile[width * height];
-	std::fill_n(tiles, width * height, Tile::EMPTY);
-
 	this->world = world;
 	this->width = width;
 	this->height = height;
 
-	// b2BodyDef body_def = b2DefaultBodyDef();
-	// body = b2CreateBody(world, &body_def);
+	chunks_x = (width + chunk_size - 1) / chunk_size;
+	chunks_y = (height + chunk_size - 1) / chunk_size;
+	chunks.resize(chunks_x * chunks_y);
+
+	// Start with every chunk loaded, stream() evicts the ones that aren't needed
+	for (int chunk = 0; chunk < chunk_count(); chunk++) {
+		chunks[chunk] = std::make_unique<Chunk>();
+		std::fill_n(chunks[chunk]->tiles, chunk_size * chunk_size, Tile::EMPTY);
+	}
+
 	generate_collision();
+	generate_clearance();
+}
+
+static unsigned int widest(const std::vector<std::string>& rows) {
+	size_t width = 0;
+	for (const auto& row : rows) width = std::max(width, row.size());
+	return width;
 }
 
-Tilemap::~Tilemap() {
-	delete[] tiles;
+Tilemap::Tilemap(b2WorldId world, const std::vector<std::string>& rows) : Tilemap(world, widest(rows), rows.size()) {
+	// One row of text per row of tiles, '#' is a wall and anything else is empty
+	for (int y = 0; y < rows.size(); y++)
+	for (int x = 0; x < rows[y].size(); x++) {
+		if (rows[y][x] == '#') set_tile(x, y, Tile::WALL);
+	}
+
+	generate_collision();
+	generate_clearance();
 }
 
 int Tilemap::tile_index(const unsigned int x, const unsigned int y) const {
@@ -28,11 +51,13 @@ std::tuple<int, int> Tilemap::tile_coord(const int i) const {
 }
 
 Tile Tilemap::operator()(const unsigned int x, const unsigned int y) const {
-	return tiles[ tile_index(x, y) ];
-}
+	int xi = x, yi = y;
 
-Tile& Tilemap::operator()(const unsigned int x, const unsigned int y) {
-	return tiles[ tile_index(x, y) ];
+	if (yi < 0) return Tile::EMPTY; // Open sky above the map
+	if ( !loaded(xi, yi) ) return Tile::WALL; // Past the outer walls or not streamed in
+
+	const Chunk& chunk = *chunks[ chunk_of(xi, yi) ];
+	return chunk.tiles[ (yi % chunk_size) * chunk_size + xi % chunk_size ];
 }
 
 int Tilemap::get_width() const {
@@ -43,13 +68,249 @@ int Tilemap::get_height() const {
 	return height;
 }
 
+int Tilemap::chunk_count() const {
+	return chunks.size();
+}
+
+int Tilemap::chunk_of(int x, int y) const {
+	if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+	return chunks_x * (y / chunk_size) + x / chunk_size;
+}
+
+TileRect Tilemap::chunk_bounds(int chunk) const {
+	TileRect bounds;
+	bounds.x0 = chunk % chunks_x * chunk_size;
+	bounds.y0 = chunk / chunks_x * chunk_size;
+	bounds.x1 = std::min<int>(bounds.x0 + chunk_size, width) - 1;
+	bounds.y1 = std::min<int>(bounds.y0 + chunk_size, height) - 1;
+
+	return bounds;
+}
+
+bool Tilemap::chunk_loaded(int chunk) const {
+	return chunks[chunk] != nullptr;
+}
+
+bool Tilemap::loaded(int x, int y) const {
+	int chunk = chunk_of(x, y);
+	return chunk != -1 && chunk_loaded(chunk);
+}
+
+bool Tilemap::stream(const std::vector<b2Vec2>& centers, float radius) {
+	// Load chunks within radius of any center and evict the rest, returns true if any changed
+	bool changed = false;
+
+	for (int chunk = 0; chunk < chunk_count(); chunk++) {
+		TileRect bounds = chunk_bounds(chunk);
+		bool needed = false;
+
+		for (const auto& center : centers) {
+			// Closest point in the chunk to center
+			b2Vec2 p;
+			p.x = std::clamp<float>(center.x, bounds.x0, bounds.x1 + 1);
+			p.y = std::clamp<float>(center.y, bounds.y0, bounds.y1 + 1);
+
+			if (b2Distance(p, center) <= radius) needed = true;
+		}
+
+		if ( needed == chunk_loaded(chunk) ) continue;
+
+		if (needed) load_chunk(chunk);
+		else evict_chunk(chunk);
+		changed = true;
+	}
+
+	return changed;
+}
+
+void Tilemap::load_chunk(int chunk) {
+	if ( chunk_loaded(chunk) ) return;
+
+	chunks[chunk] = std::make_unique<Chunk>();
+	Tile* tiles = chunks[chunk]->tiles;
+	std::fill_n(tiles, chunk_size * chunk_size, Tile::EMPTY);
+
+	// Decode the archived runs
+	auto stored = archive.find(chunk);
+	if ( stored != archive.end() ) {
+		int i = 0;
+		for (int run = 0; run < stored->second.size(); run += 2) {
+			int count = stored->second[run];
+			std::fill_n(tiles + i, count, static_cast<Tile>(stored->second[run+1]));
+			i += count;
+		}
+
+		archive.erase(stored);
+	}
+
+	generate_chunk_collision(chunk);
+	update_clearance( chunk_bounds(chunk) );
+}
+
+void Tilemap::evict_chunk(int chunk) {
+	if ( !chunk_loaded(chunk) ) return;
+
+	// Encode the tiles as runs of count and tile
+	const Tile* tiles = chunks[chunk]->tiles;
+	std::vector<unsigned char> runs;
+	bool empty = true;
+
+	for (int i = 0; i < chunk_size * chunk_size;) {
+		int count = 1;
+		while (i + count < chunk_size * chunk_size && tiles[i + count] == tiles[i] && count < 255) count++;
+
+		runs.push_back(count);
+		runs.push_back( static_cast<unsigned char>(tiles[i]) );
+		if (tiles[i] != Tile::EMPTY) empty = false;
+
+		i += count;
+	}
+
+	if (!empty) archive[chunk] = runs;
+
+	if ( b2Body_IsValid(chunks[chunk]->body) ) b2DestroyBody(chunks[chunk]->body);
+#ifndef NAV_HEADLESS
+	if (chunks[chunk]->texture.id != 0) UnloadRenderTexture(chunks[chunk]->texture);
+#endif
+	chunks[chunk].reset();
+
+	// Neighbors now see this chunk as walls
+	update_clearance( chunk_bounds(chunk) );
+}
+
+Clearance Tilemap::clearance(int x, int y) const {
+	if (y < 0) return Clearance {max_clearance, max_clearance}; // Open sky above the map
+	if ( !loaded(x, y) ) return Clearance();
+
+	const Chunk& chunk = *chunks[ chunk_of(x, y) ];
+	return chunk.clearance[ (y % chunk_size) * chunk_size + x % chunk_size ];
+}
+
+void Tilemap::generate_clearance() {
+	// Call after editing tiles through set_tile() instead of toggle_tile()
+	update_clearance( TileRect {0, 0, static_cast<int>(width) - 1, static_cast<int>(height) - 1} );
+}
+
+Clearance Tilemap::measure_clearance(int x, int y) const {
+	Clearance c;
+	if ( (*this)(x, y) == Tile::WALL ) return c;
+
+	// Count up into the sky, which is always empty
+	int up = 0;
+	while ( up < max_clearance && (*this)(x, y - up) == Tile::EMPTY ) up++;
+
+	int left = 0, right = 0;
+	while ( left < max_clearance && (*this)(x - left - 1, y) == Tile::EMPTY ) left++;
+	while ( right < max_clearance && (*this)(x + right + 1, y) == Tile::EMPTY ) right++;
+
+	c.up = up;
+	c.across = std::min(1 + left + right, int(max_clearance));
+
+	return c;
+}
+
+void Tilemap::update_clearance(TileRect rect) {
+	// Tiles below and beside rect within max_clearance can see changes in it
+	rect.x0 = std::max(rect.x0 - max_clearance, 0);
+	rect.x1 = std::min<int>(rect.x1 + max_clearance, width - 1);
+	rect.y1 = std::min<int>(rect.y1 + max_clearance, height - 1);
+
+	for (int x = rect.x0; x <= rect.x1; x++)
+	for (int y = rect.y0; y <= rect.y1; y++) {
+		int chunk = chunk_of(x, y);
+		if ( !chunk_loaded(chunk) ) continue;
+
+		chunks[chunk]->clearance[ (y % chunk_size) * chunk_size + x % chunk_size ] = measure_clearance(x, y);
+	}
+}
+
+TileHit Tilemap::raycast(b2Vec2 from, b2Vec2 to) const {
+	// Step through the tiles the ray crosses in order, always over the nearer of the next x or y boundary
+	TileHit result;
+	result.point = to;
+
+	b2Vec2 d = to - from;
+	int x = floor(from.x), y = floor(from.y);
+	int end_x = floor(to.x), end_y = floor(to.y);
+	int step_x = sign(d.x), step_y = sign(d.y);
+
+	// Fraction of the ray between boundaries on each axis, and to the first boundary
+	float delta_x = d.x != 0.0? 1.0 / abs(d.x) : INFINITY;
+	float delta_y = d.y != 0.0? 1.0 / abs(d.y) : INFINITY;
+	float next_x = d.x > 0.0? (x + 1 - from.x) * delta_x : d.x < 0.0? (from.x - x) * delta_x : INFINITY;
+	float next_y = d.y > 0.0? (y + 1 - from.y) * delta_y : d.y < 0.0? (from.y - y) * delta_y : INFINITY;
+	float t = 0.0;
+
+	while (t <= 1.0) {
+		// Unloaded tiles and those past the outer walls block the ray too
+		if ( (*this)(x, y) == Tile::WALL ) {
+			result.hit = true;
+			result.x = x;
+			result.y = y;
+			result.fraction = t;
+			result.point = from + t * d;
+			break;
+		}
+
+		if (x == end_x && y == end_y) break;
+
+		if (next_x < next_y) {
+			t = next_x;
+			next_x += delta_x;
+			x += step_x;
+		}
+		else {
+			t = next_y;
+			next_y += delta_y;
+			y += step_y;
+		}
+	}
+
+	return result;
+}
+
+std::vector<TileHit> Tilemap::raycast(const std::vector<TileRay>& rays) const {
+	// Cast on the job system, the tiles must not change until this returns
+	std::vector<TileHit> hits( rays.size() );
+
+	jobs.wait( jobs.parallel_for(rays.size(), 64, [&](int start, int end, int) {
+		for (int i = start; i < end; i++) hits[i] = raycast(rays[i].from, rays[i].to);
+	}) );
+
+	return hits;
+}
+
+bool Tilemap::line_of_sight(b2Vec2 from, b2Vec2 to) const {
+	return !raycast(from, to).hit;
+}
+
 Vector2 Tilemap::tile_to_world(unsigned int x, unsigned int y) {
 	float size = static_cast<float>(tile_size);
 	return Vector2 {x*size, y*size};
 }
 
+void Tilemap::set_tile(int x, int y, Tile tile) {
+	// Call generate_clearance() after setting tiles, toggle_tile() keeps it up to date itself
+	int chunk = chunk_of(x, y);
+	if (chunk == -1) return; // Outside the map
+
+	// Writing to an evicted chunk streams it back in
+	if ( !chunks[chunk] ) load_chunk(chunk);
+
+	Tile& current = chunks[chunk]->tiles[ (y % chunk_size) * chunk_size + x % chunk_size ];
+	if (current == tile) return;
+
+	current = tile;
+	chunks[chunk]->dirty = true;
+}
+
 void Tilemap::toggle_tile(int x, int y) {
-	(*this)(x,y) = (*this)(x,y) == Tile::WALL?  Tile::EMPTY : Tile::WALL;
+	if (chunk_of(x, y) == -1) return;
+	set_tile( x, y, (*this)(x,y) == Tile::WALL?  Tile::EMPTY : Tile::WALL );
+
+	TileRect edit;
+	edit.include(x, y);
+	update_clearance(edit);
 }
 
 void Tilemap::generate_collision() {
@@ -58,10 +319,9 @@ void Tilemap::generate_collision() {
 	b2BodyDef body_def = b2DefaultBodyDef();
 	body = b2CreateBody(world, &body_def);
 
-	// Add shapes to the body
-	for (int x = 0; x < width; x++)
-	for (int y = 0; y < height; y++) {
-		if ( (*this)(x,y) == Tile::WALL ) add_collider(x, y);
+	// Each chunk has its own body
+	for (int chunk = 0; chunk < chunk_count(); chunk++) {
+		if ( chunk_loaded(chunk) ) generate_chunk_collision(chunk);
 	}
 
 	// Add the outer walls
@@ -81,10 +341,50 @@ void Tilemap::generate_collision() {
 	b2CreateSegmentShape(body, &shape_right, &wall_right);
 }
 
-void Tilemap::render() {
-	for (int x = 0; x < width; x++)
-	for (int y = 0; y < height; y++) {
-		if ( (*this)(x,y) == Tile::WALL ) render_tile(x, y);
+void Tilemap::generate_collision(int x, int y) {
+	// Only rebuild the chunk containing the tile
+	int chunk = chunk_of(x, y);
+	if ( chunk != -1 && chunk_loaded(chunk) ) generate_chunk_collision(chunk);
+}
+
+void Tilemap::generate_chunk_collision(int chunk) {
+	Chunk& c = *chunks[chunk];
+
+	// Destroy and recreate the body
+	if ( b2Body_IsValid(c.body) ) b2DestroyBody(c.body);
+	b2BodyDef body_def = b2DefaultBodyDef();
+	c.body = b2CreateBody(world, &body_def);
+
+	TileRect bounds = chunk_bounds(chunk);
+	for (int x = bounds.x0; x <= bounds.x1; x++)
+	for (int y = bounds.y0; y <= bounds.y1; y++) {
+		if ( c.tiles[ (y % chunk_size) * chunk_size + x % chunk_size ] == Tile::WALL ) add_collider(c.body, x, y);
+	}
+}
+
+#ifndef NAV_HEADLESS
+void Tilemap::bake() {
+	// Must be called outside of BeginDrawing() since texture mode resets the camera
+	for (int chunk = 0; chunk < chunk_count(); chunk++) {
+		if ( chunk_loaded(chunk) && chunks[chunk]->dirty ) bake_chunk(chunk);
+	}
+}
+
+void Tilemap::render(Rectangle view) {
+	// Only draw chunks the camera can see
+	for (int chunk = 0; chunk < chunk_count(); chunk++) {
+		if ( !chunk_loaded(chunk) ) continue;
+
+		const Chunk& c = *chunks[chunk];
+		if (c.texture.id == 0) continue; // Not baked yet
+
+		TileRect bounds = chunk_bounds(chunk);
+		Vector2 origin = tile_to_world(bounds.x0, bounds.y0);
+		Rectangle area = {origin.x, origin.y, chunk_size * tile_size, chunk_size * tile_size};
+		if ( !CheckCollisionRecs(view, area) ) continue;
+
+		// Render textures are stored upside down
+		DrawTextureRec( c.texture.texture, Rectangle {0, 0, area.width, -area.height}, origin, WHITE );
 	}
 
 	// Draw a border around the edge
@@ -93,12 +393,13 @@ void Tilemap::render() {
 	DrawLine(0,0, 0, height*tile_size, SKYBLUE);
 	DrawLine(width*tile_size,0, width*tile_size, height*tile_size, SKYBLUE);
 }
+#endif
 
-void Tilemap::add_collider(unsigned int x, unsigned int y) {
+void Tilemap::add_collider(b2BodyId body, unsigned int x, unsigned int y) {
 	float size = static_cast<float>(tile_size)/2.0f/world_scale;
 
 	Vector2 center = tile_to_world(x,y);
-	center = Vector2Divide( center, Vector2 {world_scale, world_scale} );
+	center = Vector2 {center.x / world_scale, center.y / world_scale};
 
 	b2Polygon box = b2MakeOffsetBox(size, size, b2Vec2 {center.x + size, center.y + size}, b2MakeRot(0.0f));
 
@@ -107,6 +408,24 @@ void Tilemap::add_collider(unsigned int x, unsigned int y) {
 	b2CreatePolygonShape(body, &shape_def, &box);
 }
 
-void Tilemap::render_tile(unsigned int x, unsigned int y) {
-	DrawRectangleV( tile_to_world(x,y), {tile_size, tile_size}, GRAY );
+#ifndef NAV_HEADLESS
+void Tilemap::bake_chunk(int chunk) {
+	Chunk& c = *chunks[chunk];
+	if (c.texture.id == 0) c.texture = LoadRenderTexture(chunk_size * tile_size, chunk_size * tile_size);
+
+	TileRect bounds = chunk_bounds(chunk);
+	Vector2 origin = tile_to_world(bounds.x0, bounds.y0);
+
+	BeginTextureMode(c.texture);
+	ClearBackground(BLANK);
+
+	for (int x = bounds.x0; x <= bounds.x1; x++)
+	for (int y = bounds.y0; y <= bounds.y1; y++) {
+		if ( c.tiles[ (y % chunk_size) * chunk_size + x % chunk_size ] == Tile::WALL )
+			DrawRectangleV( Vector2Subtract(tile_to_world(x,y), origin), {tile_size, tile_size}, GRAY );
+	}
+
+	EndTextureMode();
+	c.dirty = false;
 }
+#endif
@@ -1,8 +1,18 @@
 #pragma once
 
 #include <tuple>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <string>
+
+#ifndef NAV_HEADLESS
 #include <raylib.h>
 #include <raymath.h>
+#else
+struct Vector2 { float x, y; }; // Stands in for raylib's, headless builds don't render
+#endif
 
 #include "physics.hh"
 
@@ -25,37 +35,119 @@ struct TileCoord {
 	}
 };
 
+struct Clearance {
+	unsigned char up = 0; // Empty tiles from this one upward
+	unsigned char across = 0; // Empty tiles in the run along this one's row
+};
+
+struct TileRect {
+	int x0 = 0, y0 = 0;
+	int x1 = -1, y1 = -1; // Inclusive, the rect is empty while x1 < x0
+
+	bool empty() const {
+		return x1 < x0 || y1 < y0;
+	}
+
+	bool contains(int x, int y) const {
+		return x >= x0 && x <= x1 && y >= y0 && y <= y1;
+	}
+
+	void include(int x, int y) {
+		if ( empty() ) {
+			x0 = x1 = x;
+			y0 = y1 = y;
+			return;
+		}
+
+		x0 = std::min(x0, x); x1 = std::max(x1, x);
+		y0 = std::min(y0, y); y1 = std::max(y1, y);
+	}
+};
+
+struct TileRay {
+	b2Vec2 from, to; // In tiles
+};
+
+struct TileHit {
+	bool hit = false; // A wall was reached before the end of the ray
+	int x = -1, y = -1; // Wall tile that was hit
+	float fraction = 1.0; // Of the way along the ray to where it entered the wall
+	b2Vec2 point = {0, 0}; // Where the ray entered the wall, or its end if nothing was hit
+};
+
 class Tilemap {
+public:
+	static const int tile_size = 32;
+	static const int chunk_size = 16; // Width and height of a chunk in tiles
+	static const int max_clearance = 15; // Clearances are capped so an edit only affects tiles near it
+
 private:
+	struct Chunk {
+		Tile tiles[chunk_size * chunk_size];
+		Clearance clearance[chunk_size * chunk_size];
+		b2BodyId body = b2_nullBodyId;
+#ifndef NAV_HEADLESS
+		RenderTexture2D texture = {}; // Walls drawn once, redrawn by bake() when dirty
+#endif
+		bool dirty = true;
+	};
+
 	b2WorldId world;
-	b2BodyId body;
+	b2BodyId body = b2_nullBodyId; // Outer walls
 
-	Tile* tiles;
+	std::vector< std::unique_ptr<Chunk> > chunks; // Null while a chunk is evicted
+	std::unordered_map< int, std::vector<unsigned char> > archive; // Run length encoded evicted chunks, empty ones aren't kept
 
 	unsigned int width, height;
+	unsigned int chunks_x, chunks_y;
+
+	void load_chunk(int chunk);
+	void evict_chunk(int chunk);
+	void generate_chunk_collision(int chunk);
 
-	void add_collider(unsigned int x, unsigned int y);
-	void render_tile(unsigned int x, unsigned int y);
+	Clearance measure_clearance(int x, int y) const;
+	void update_clearance(TileRect rect);
+
+	void add_collider(b2BodyId body, unsigned int x, unsigned int y);
+#ifndef NAV_HEADLESS
+	void bake_chunk(int chunk);
+#endif
 
 	friend class FlowMap;
 
 public:
-	static const int tile_size = 32;
-
 	Tilemap(b2WorldId world, unsigned int width, unsigned int height);
-	~Tilemap();
+	Tilemap(b2WorldId world, const std::vector<std::string>& rows);
 
 	int tile_index(const unsigned int x, const unsigned int y) const;
 	std::tuple<int, int> tile_coord(const int i) const;
 	Tile operator()(const unsigned int x, const unsigned int y) const;
-	Tile& operator()(const unsigned int x, const unsigned int y);
 	int get_width() const;
 	int get_height() const;
 
+	int chunk_count() const;
+	int chunk_of(int x, int y) const;
+	TileRect chunk_bounds(int chunk) const;
+	bool chunk_loaded(int chunk) const;
+	bool loaded(int x, int y) const;
+	bool stream(const std::vector<b2Vec2>& centers, float radius);
+
+	Clearance clearance(int x, int y) const;
+	void generate_clearance();
+
+	TileHit raycast(b2Vec2 from, b2Vec2 to) const;
+	std::vector<TileHit> raycast(const std::vector<TileRay>& rays) const;
+	bool line_of_sight(b2Vec2 from, b2Vec2 to) const;
+
 	Vector2 tile_to_world(unsigned int x, unsigned int y);
 
+	void set_tile(int x, int y, Tile tile);
 	void toggle_tile(int x, int y);
 	void generate_collision();
+	void generate_collision(int x, int y);
 
-	void render();
+#ifndef NAV_HEADLESS
+	void bake();
+	void render(Rectangle view);
+#endif
 };
@@ -1,5 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <box2d/box2d.h>
+
+#ifndef NAV_HEADLESS
+#include <raylib.h>
+#endif
+
 template <typename T> T sign(T n) {
 	return ( T(0) < n ) - ( n < T(0) );
 }
+
+#ifndef NAV_HEADLESS
+// Check if the box around a line, in pixels, overlaps the camera view
+inline bool in_view(Rectangle view, b2Vec2 p0, b2Vec2 p1, float margin = 0.0) {
+	Rectangle box = {
+		std::min(p0.x, p1.x) - margin,
+		std::min(p0.y, p1.y) - margin,
+		std::abs(p1.x - p0.x) + 2*margin,
+		std::abs(p1.y - p0.y) + 2*margin,
+	};
+
+	return CheckCollisionRecs(view, box);
+}
+#endif
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <box2d/box2d.h>
+
+#include "physics.hh"
+#include "tilemap.hh"
+#include "nav_mesh.hh"
+#include "replanner.hh"
+
+using namespace std;
+
+// Checks that repairing a Replanner after random tile edits finds the same time to goal as planning from scratch
+
+const int width = 64;
+const int height = 48;
+const int trials = 300;
+const int edits = 20;
+
+int main(int argc, char const *argv[]) {
+	auto world = init_world();
+	mt19937 random(28);
+	int failures = 0, checks = 0;
+
+	for (int trial = 0; trial < trials; trial++) {
+		// Floor with scattered platforms
+		Tilemap tilemap(world, width, height);
+		for (int x = 0; x < width; x++) tilemap.set_tile(x, height - 1, Tile::WALL);
+
+		for (int platform = 0; platform < 40; platform++) {
+			int x = random() % (width - 8), y = 4 + random() % (height - 8), length = 2 + random() % 6;
+			for (int i = 0; i < length; i++) tilemap.set_tile(x + i, y, Tile::WALL);
+		}
+
+		tilemap.generate_collision();
+		tilemap.generate_clearance();
+
+		NavMesh nav_mesh(tilemap);
+		if ( !nav_mesh.valid() ) continue;
+
+		auto random_node = [&]() {
+			b2Vec2 p = { float(random() % width), float(random() % height) };
+			return nav_mesh.get_closest(p).position;
+		};
+
+		b2Vec2 from = random_node(), to = random_node();
+		Replanner replanner(nav_mesh);
+		replanner.set_goal(from, to);
+
+		for (int edit = 0; edit < edits; edit++) {
+			// Leave the start and goal nodes and the floor under them alone so both stay put
+			int x = random() % width, y = random() % (height - 1);
+			bool keep = false;
+			for (const b2Vec2 p : {from, to}) {
+				if ( x == int(p.x) && (y == int(p.y) || y == int(p.y) + 1) ) keep = true;
+			}
+			if (keep) continue;
+
+			tilemap.toggle_tile(x, y);
+			tilemap.generate_collision(x, y);
+			nav_mesh.generate();
+
+			Path repaired = replanner.update( nav_mesh.get_changes() );
+
+			Replanner fresh(nav_mesh);
+			Path planned = fresh.set_goal(from, to);
+
+			checks++;
+			bool same = isinf( replanner.cost() )? isinf( fresh.cost() ) : abs( replanner.cost() - fresh.cost() ) < 1e-3;
+			if ( !same || repaired.empty() != planned.empty() ) {
+				cerr << "trial " << trial << " edit " << edit << " at " << x << ", " << y << ": repaired time " << replanner.cost()
+					<< " with " << repaired.size() << " segments, planned " << fresh.cost() << " with " << planned.size() << endl;
+				failures++;
+			}
+		}
+	}
+
+	b2DestroyWorld(world);
+
+	if (failures > 0) {
+		cerr << failures << " of " << checks << " repairs differ from a fresh plan" << endl;
+		return 1;
+	}
+
+	cout << checks << " repairs match a fresh plan" << endl;
+	return 0;
+}
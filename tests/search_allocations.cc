@@ -0,0 +1,121 @@
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <box2d/box2d.h>
+
+#include "physics.hh"
+#include "tilemap.hh"
+#include "nav_mesh.hh"
+#include "pathfinder.hh"
+#include "agent.hh"
+
+using namespace std;
+
+// Checks that planning does no heap allocation once its search context is warmed up
+// The returned path is a deque the caller owns, so only what building one costs is allowed
+
+static atomic<long> allocations = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+	if (void* p = malloc(size)) return p;
+	throw bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static long built_path_allocations(size_t segments) {
+	// Paths are built from the goal back to the start
+	long before = allocations;
+	{
+		Path path;
+		for (size_t i = 0; i < segments; i++) path.push_front( PathSegment {} );
+	}
+	return allocations - before;
+}
+
+static long copied_path_allocations(const Path& path) {
+	long before = allocations;
+	{
+		Path copy(path);
+	}
+	return allocations - before;
+}
+
+int main(int argc, char const *argv[]) {
+	auto world = init_world();
+
+	// A floor with a wall to jump and a platform over it
+	Tilemap tilemap(world, 48, 24);
+	for (int x = 0; x < 48; x++) tilemap.set_tile(x, 23, Tile::WALL);
+	for (int y = 18; y < 23; y++) tilemap.set_tile(24, y, Tile::WALL);
+	for (int x = 6; x < 14; x++) tilemap.set_tile(x, 18, Tile::WALL);
+	tilemap.generate_collision();
+	tilemap.generate_clearance();
+
+	NavMesh nav_mesh(tilemap);
+	Agent agent(world, 2.5, 22.0); // Standing on the floor
+	Pathfinder pathfinder(agent, nav_mesh);
+
+	const b2Vec2 start = {2.5, 22.5};
+	const b2Vec2 goals[] = { {44.5, 22.5}, {9.5, 17.5}, {30.5, 22.5}, {20.5, 22.5} };
+	int failures = 0;
+
+	// Warm up so the context has grown to fit the mesh
+	SearchStats stats;
+	for (const b2Vec2 goal : goals) pathfinder.find_path(start, goal, stats);
+	pathfinder.set_goal(goals[3]);
+
+	for (int round = 0; round < 3; round++)
+	for (const b2Vec2 goal : goals) {
+		long before = allocations;
+		Path path = pathfinder.find_path(start, goal, stats);
+		long used = allocations - before;
+
+		long expected = built_path_allocations( path.size() );
+		if (used != expected) {
+			cerr << "find_path to " << goal.x << ", " << goal.y << " made " << used << " allocations, the path needs " << expected << endl;
+			failures++;
+		}
+	}
+
+	// set_goal checks for a straight walk first, which must not cost anything when it isn't one
+	for (int round = 0; round < 3; round++) {
+		long before = allocations;
+		Path path = pathfinder.set_goal(goals[0]);
+		long used = allocations - before;
+
+		long expected = built_path_allocations( path.size() );
+		if (used != expected) {
+			cerr << "set_goal made " << used << " allocations, the path needs " << expected << endl;
+			failures++;
+		}
+	}
+
+	// A straight walk skips the search and returns a copy of the reused walk
+	for (int round = 0; round < 3; round++) {
+		long before = allocations;
+		Path path = pathfinder.set_goal(goals[3]);
+		long used = allocations - before;
+
+		long expected = copied_path_allocations(path);
+		if (used != expected) {
+			cerr << "set_goal walk made " << used << " allocations, the path needs " << expected << endl;
+			failures++;
+		}
+	}
+
+	b2DestroyWorld(world);
+
+	if (failures > 0) return 1;
+	cout << "no allocations in steady state search" << endl;
+	return 0;
+}